@@ -5,10 +5,19 @@
 #ifndef _APU_H
 #define _APU_H
 
+#define APU_SAMPLE_RATE 44100
+
 void Apu_Init();
 void Apu_Reset();
-void Apu_Step(int cycle_budget, u32 keystate);
+void Apu_Step(int cycle_budget);
+void Apu_SetOutput(bool on);
+const float *Apu_Samples(size_t *count);
+void Apu_ClearSamples();
+void Apu_ToggleMute(int channel);
 u8 Apu_Read(u16 addr);
 void Apu_Write(u8 data, u16 addr);
+size_t Apu_StateSize();
+u8 *Apu_SaveState(u8 *p);
+const u8 *Apu_LoadState(const u8 *p);
 
 #endif
@@ -11,6 +11,7 @@
 #define _CART_H
 
 #include <utils.h>
+#include <romdb.h>
 
 enum mirror_mode {
 	MIR_HORZ,
@@ -23,14 +24,44 @@ enum mirror_mode {
 
 #define PRGROM_BANK_SIZE (16*1024)
 #define CHRROM_BANK_SIZE (8*1024)
+// granularity of the bank maps
+#define PRG_SLOT_SIZE (8*1024)
+#define CHR_SLOT_SIZE (1*1024)
+
+// pattern table tiles ($0000-$1FFF as the ppu sees it) written or remapped
+// since a consumer last asked. tile = addr >> 4 is bit (tile & 63) of word
+// (tile >> 6), so a word covers one chr slot.
+#define CHR_TILE_SIZE 16
+#define CHR_TILES (0x2000 / CHR_TILE_SIZE)
+#define CHR_DIRTY_WORDS (CHR_TILES / 64)
+enum chr_consumer {
+	CHR_PT_VIEW, // Ppu_DrawPT's decoded tiles
+	CHR_LIBNES,  // Nes_ChrDirty
+	CHR_CONSUMERS,
+};
 
 void Cart_Init();
-void Cart_Load(const char *path);
+bool Cart_Load(const u8 *rom, size_t len);
+void Cart_Reset();
+void Cart_SetSaveFile(const char *path);
+void Cart_SetRomDb(const romdb_t *db);
+void Cart_FlushSave();
 u8 Cart_CpuRead(u16 addr);
+const u8 *Cart_CpuPage(u8 hi);
 void Cart_CpuWrite(u8 data, u16 addr);
 u8 Cart_PpuRead(u16 addr);
 void Cart_PpuWrite(u8 data, u16 addr);
 enum mirror_mode Cart_GetMirrorMode();
+u16 Cart_GetMapperNum();
 void Cart_Dump();
+void Cart_MapPrg(u16 addr, u32 size, u32 bank);
+void Cart_MapChr(u16 addr, u32 size, u32 bank);
+void Cart_SetMirrorMode(enum mirror_mode mode);
+void Cart_ChrDirty(enum chr_consumer who, u64 dirty[CHR_DIRTY_WORDS]);
+void Cart_A12Changing();
+void Cart_A12Changed();
+size_t Cart_StateSize();
+u8 *Cart_SaveState(u8 *p);
+const u8 *Cart_LoadState(const u8 *p);
 
 #endif
\ No newline at end of file
@@ -10,10 +10,25 @@
 #ifndef _CPU_H
 #define _CPU_H
 
+#include <utils.h>
+
+// devices which can pull the irq line low
+enum irq_source {
+    IRQ_APU_FRAME = (1 << 0),
+    IRQ_APU_DMC   = (1 << 1),
+    IRQ_MAPPER    = (1 << 2),
+};
+
 void Cpu_Init();
 int Cpu_Step();
-void Cpu_Irq();
+void Cpu_SetIrq(u8 source);
+void Cpu_ClearIrq(u8 source);
+void Cpu_Stall(int cycles);
+void Cpu_OamDma();
 void Cpu_Nmi();
 void Cpu_Reset();
+size_t Cpu_StateSize();
+u8 *Cpu_SaveState(u8 *p);
+const u8 *Cpu_LoadState(const u8 *p);
 
 #endif
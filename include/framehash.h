@@ -0,0 +1,20 @@
+/*
+ * framehash.h
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Header for the frame hash stream.
+ */
+
+#ifndef _FRAMEHASH_H
+#define _FRAMEHASH_H
+
+#include <utils.h>
+
+void FrameHash_Open(const char *out_path, const char *golden_path);
+bool FrameHash_Active();
+void FrameHash_Push(u64 hash);
+u32 FrameHash_Close();
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ * ines.h
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Header for the iNES / NES 2.0 rom header parser.
+ */
+
+#ifndef _INES_H
+#define _INES_H
+
+#include <utils.h>
+#include <cart.h>
+
+#define INES_HEADER_SIZE 16
+#define INES_TRAINER_SIZE 512
+
+// iNES as describe from nes dev, sizes in bytes
+// https://wiki.nesdev.com/w/index.php/INES
+// https://wiki.nesdev.com/w/index.php/NES_2.0
+typedef struct ines_header {
+    bool nes2;            // NES 2.0 header, the ram sizes are exact
+    size_t prgrom_size;
+    size_t chrrom_size;
+    u32 prgram_size;      // volatile PRG RAM
+    u32 prgnvram_size;    // battery-backed PRG RAM
+    u32 chrram_size;
+    u32 chrnvram_size;
+    bool battery;         // battery-backed ram present
+    bool trainer;         // 512-byte trainer present
+    u16 mapper_num;       // Cartridge Mapper number
+    u8 submapper;
+    enum mirror_mode mirror_mode;
+} ines_header_t;
+
+bool Ines_ReadHeader(const u8 *filebuf, size_t len, ines_header_t *header);
+u32 Ines_DataCrc(const ines_header_t *header, const u8 *filebuf, size_t len);
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * libnes.h
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Embeddable emulator core. No sdl, no windows and no clocks: the caller
+ * loads a rom, sets the pads, steps and reads back the frame and audio.
+ *
+ * All state is per thread, so every thread that calls Nes_Init gets its own
+ * independent console. Loads return false on a rom that can't be read,
+ * inflated or run: a rom that can't be read or inflated leaves the old one
+ * running, one that can't be run leaves no rom and the next call has to be
+ * another load. Errors in the emulation are still fatal (see
+ * Utils_SetExitHandler).
+ */
+
+#ifndef _LIBNES_H
+#define _LIBNES_H
+
+#include <utils.h>
+#include <ppu.h>
+#include <cart.h>
+
+#define NES_RES_X PPU_RES_X
+#define NES_RES_Y PPU_RES_Y
+#define NES_SAMPLE_RATE 44100
+#define NES_CHR_DIRTY_WORDS CHR_DIRTY_WORDS
+
+// controller buttons, in the order the pad shifts them out (A first)
+enum nes_button {
+    NES_RIGHT = (1 << 0),
+    NES_LEFT = (1 << 1),
+    NES_DOWN = (1 << 2),
+    NES_UP = (1 << 3),
+    NES_START = (1 << 4),
+    NES_SELECT = (1 << 5),
+    NES_B = (1 << 6),
+    NES_A = (1 << 7),
+};
+
+void Nes_Init();
+bool Nes_LoadRom(const u8 *rom, size_t len);
+bool Nes_LoadRomFile(const char *path);
+void Nes_Reset();
+void Nes_SetSaveFile(const char *path);
+bool Nes_SetRomDb(const char *path);
+void Nes_SetInput(int port, u8 buttons);
+u32 Nes_StepFrame();
+bool Nes_StepCycles(u32 cycles);
+const nes_color_t *Nes_Frame();
+u64 Nes_HashFrame();
+const float *Nes_Audio(size_t *count);
+void Nes_SetSkipRender(bool skip);
+void Nes_SetAudioOutput(bool on);
+void Nes_ChrDirty(u64 dirty[NES_CHR_DIRTY_WORDS]);
+size_t Nes_StateSize();
+void Nes_SaveState(u8 *buf);
+bool Nes_LoadState(const u8 *buf, size_t len);
+
+#endif
@@ -13,33 +13,48 @@
 #include <utils.h>
 #include <cart.h>
 
-typedef bool (*mapper_rfunc_t)(u32*);
-typedef bool (*mapper_wfunc_t)(u8, u32*);
-typedef void (*mapper_init_t)(u8, u8);
-typedef enum mirror_mode (*mapper_mirfunc_t)(void);
-
-// Mapper 0
-void Map000_Init(u8 prgrom_banks, u8 chrrom_banks);
-bool Map000_CpuRead(u32 *addr);
-bool Map000_CpuWrite(u8 data, u32 *addr);
-bool Map000_PpuRead(u32 *addr);
-bool Map000_PpuWrite(u8 data, u32 *addr);
-enum mirror_mode Map000_GetMirrorMode();
-
-// Mapper 1
-void Map001_Init(u8 prgrom_banks, u8 chrrom_banks);
-bool Map001_CpuRead(u32 *addr);
-bool Map001_CpuWrite(u8 data, u32 *addr);
-bool Map001_PpuRead(u32 *addr);
-bool Map001_PpuWrite(u8 data, u32 *addr);
-enum mirror_mode Map001_GetMirrorMode();
-
-// Mapper 2
-void Map002_Init(u8 prgrom_banks, u8 chrrom_banks);
-bool Map002_CpuRead(u32 *addr);
-bool Map002_CpuWrite(u8 data, u32 *addr);
-bool Map002_PpuRead(u32 *addr);
-bool Map002_PpuWrite(u8 data, u32 *addr);
-enum mirror_mode Map002_GetMirrorMode();
-
-#endif
\ No newline at end of file
+// mappers publish their banks with Cart_MapPrg/Cart_MapChr and mirroring
+// with Cart_SetMirrorMode, reads never reach them. writes only reach them
+// where no ram is mapped.
+typedef void (*mapper_init_t)(u16, u16);
+typedef void (*mapper_banks_t)(void);
+typedef void (*mapper_write_t)(u8, u16);
+typedef size_t (*mapper_statesize_t)(void);
+typedef u8 *(*mapper_savestate_t)(u8*);
+typedef const u8 *(*mapper_loadstate_t)(const u8*);
+typedef void (*mapper_a12_t)(void);
+
+// capability flags
+#define MAPPER_IRQ (1 << 0) // drives IRQ_MAPPER, cleared by the cart on reset
+#define MAPPER_A12 (1 << 1) // counts ppu a12 edges (see Ppu_A12Rise), needs
+                            // the a12 hooks
+
+// mapper numbers the registry has room for (iNES)
+#define MAPPER_MAX 256
+
+// One per mapper, listed in the registry (src/mappers/mappers.c) by number.
+// banks is required: the cart calls it after init and state loads, the
+// mapper after its own register writes. The rest may be NULL for mappers
+// without registers or state.
+typedef struct mapper {
+    u16 num;
+    const char *name;
+    u32 flags;
+    mapper_init_t init;             // reset the registers (prg/chr banks in 16/8 KB)
+    mapper_banks_t banks;           // publish the banks the registers select
+    mapper_write_t write;           // register writes (where no ram is mapped)
+    mapper_statesize_t statesize;
+    mapper_savestate_t savestate;
+    mapper_loadstate_t loadstate;
+    mapper_a12_t a12changing;       // the ppu is about to move its a12 edges
+    mapper_a12_t a12changed;        // and has moved them
+} mapper_t;
+
+const mapper_t *Mappers_Get(u16 num);
+
+extern const mapper_t Map000;
+extern const mapper_t Map001;
+extern const mapper_t Map002;
+extern const mapper_t Map004;
+
+#endif
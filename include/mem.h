@@ -13,10 +13,18 @@
 #include <cart.h>
 
 void Mem_Init();
+void Mem_PowerOn();
+void Mem_SetInput(int port, u8 buttons);
+u8 Mem_GetInput(int port);
 void Mem_Dump();
 void Mem_PpuWrite(u8 data, u16 addr);
 u8 Mem_PpuRead(u16 addr);
 void Mem_CpuWrite(u8 data, u16 addr);
 u8 Mem_CpuRead(u16 addr);
+const u8 *Mem_CpuPage(u8 hi);
+u8 *Mem_Iram();
+size_t Mem_StateSize();
+u8 *Mem_SaveState(u8 *p);
+const u8 *Mem_LoadState(const u8 *p);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,23 @@
+/*
+ * movie.h
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Header for input movie recording and playback.
+ */
+
+#ifndef _MOVIE_H
+#define _MOVIE_H
+
+#include <utils.h>
+
+bool Movie_Record(const char *path, const char *rompath);
+bool Movie_Play(const char *path, const char *rompath);
+bool Movie_Active();
+u8 Movie_Latch(int port);
+bool Movie_FrameEnd();
+void Movie_Reset();
+void Movie_Close();
+
+#endif
@@ -12,13 +12,30 @@
 
 #include <utils.h>
 
+#define PPU_RES_X 256
+#define PPU_RES_Y 240
+
+typedef struct nes_color
+{
+    u8 red;
+    u8 green;
+    u8 blue;
+} nes_color_t;
+
 void Ppu_Init();
 void Ppu_Reset();
 bool Ppu_Step(int clock_budget);
+void Ppu_SetSkipRender(bool skip);
+const nes_color_t *Ppu_Frame();
 u8 Ppu_RegRead(u16 reg);
 void Ppu_RegWrite(u8 val, u16 reg);
 void Ppu_Oamdma(u8 hi);
 void Ppu_Dump();
-void Ppu_DrawPT(u16 table_id, u8 pal_id);
+size_t Ppu_StateSize();
+u8 *Ppu_SaveState(u8 *p);
+const u8 *Ppu_LoadState(const u8 *p);
+u64 Ppu_A12Rise(u64 after, u32 n);
+u32 Ppu_A12Rises(u64 from, u64 to);
+void Ppu_DrawPT(u16 table_id, u8 pal_id, nes_color_t out[128*128]);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,21 @@
+/*
+ * rewind.h
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Header for the rewind buffer.
+ */
+
+#ifndef _REWIND_H
+#define _REWIND_H
+
+#include <utils.h>
+
+void Rewind_Init(int seconds);
+void Rewind_Clear();
+void Rewind_Push();
+bool Rewind_Pop();
+void Rewind_Free();
+
+#endif
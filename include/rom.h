@@ -0,0 +1,24 @@
+/*
+ * rom.h
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Header for the shared, memory mapped rom images (plain, gzip or zip).
+ */
+
+#ifndef _ROM_H
+#define _ROM_H
+
+#include <utils.h>
+
+typedef struct rom_image {
+    const u8 *data;
+    size_t len;
+} rom_image_t;
+
+const rom_image_t *Rom_Open(const char *path);
+const rom_image_t *Rom_FromMemory(const u8 *data, size_t len);
+void Rom_Close(const rom_image_t *image);
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ * romdb.h
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Header for the rom database: what carts really are, keyed by the crc32 of
+ * their prg and chr data.
+ */
+
+#ifndef _ROMDB_H
+#define _ROMDB_H
+
+#include <utils.h>
+
+// flags
+#define ROMDB_BATTERY (1 << 0) // prg-ram is battery backed
+
+// one cart, 12 bytes on disk (native byte order). ram sizes are shift
+// counts like NES 2.0 headers: 0 for none, else 64 << n bytes.
+typedef struct romdb_entry {
+    u32 crc;        // crc32 of the prg and chr data (Ines_DataCrc)
+    u16 mapper;
+    u8 submapper;
+    u8 mirror;      // enum mirror_mode: MIR_HORZ, MIR_VERT or MIR_4SCRN
+    u8 flags;
+    u8 prgram;
+    u8 chrram;
+    u8 reserved;
+} romdb_entry_t;
+
+typedef struct romdb romdb_t;
+
+romdb_t *Romdb_Open(const char *path);
+void Romdb_Close(romdb_t *db);
+size_t Romdb_Count(const romdb_t *db);
+const romdb_entry_t *Romdb_Find(const romdb_t *db, u32 crc);
+bool Romdb_Write(const char *path, romdb_entry_t *entries, size_t count);
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ * sav.h
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Header for the memory mapped battery save files.
+ */
+
+#ifndef _SAV_H
+#define _SAV_H
+
+#include <utils.h>
+
+typedef struct sav_file {
+    u8 *data;
+    size_t len;
+} sav_file_t;
+
+sav_file_t *Sav_Open(const char *path, size_t len);
+void Sav_Close(sav_file_t *sav);
+void Sav_Flush(sav_file_t *sav);
+void Sav_SyncAll();
+
+#endif
@@ -0,0 +1,38 @@
+/*
+ * scheduler.h
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Header for the event scheduler. Timestamps are in cpu cycles.
+ */
+
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include <utils.h>
+
+// timestamp used for events which are not scheduled
+#define SCHED_NEVER UINT64_MAX
+
+typedef enum sched_event {
+    EV_APU_FRAME = 0, // apu frame counter step (and frame irq)
+    EV_APU_DMC,       // dmc output cycle finished, sample buffer refill
+    EV_MAPPER_IRQ,    // mapper irq counter (mmc3 scanline counter) due
+    EV_COUNT,
+} sched_event_t;
+
+typedef void (*sched_handler_t)(u64 when);
+
+void Sched_Init();
+void Sched_Reset();
+void Sched_Register(sched_event_t ev, sched_handler_t handler);
+void Sched_Add(sched_event_t ev, u64 when);
+void Sched_Cancel(sched_event_t ev);
+void Sched_Advance(int cycles);
+u64 Sched_Now();
+size_t Sched_StateSize();
+u8 *Sched_SaveState(u8 *p);
+const u8 *Sched_LoadState(const u8 *p);
+
+#endif
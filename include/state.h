@@ -0,0 +1,33 @@
+/*
+ * state.h
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Header for save states.
+ */
+
+#ifndef _STATE_H
+#define _STATE_H
+
+#include <string.h>
+
+#include <utils.h>
+
+// bump whenever the layout of any module's state changes
+#define STATE_VERSION 2
+
+// Every module lists the variables making up its state once as an X-macro,
+// e.g. #define CPU_STATE(X) X(state) X(irq_line), and expands it with these
+// to get the size, save and load code. Save/load walk a byte cursor `p`.
+#define STATE_SIZE(var) + sizeof(var)
+#define STATE_SAVE(var) memcpy(p, &(var), sizeof(var)); p += sizeof(var);
+#define STATE_LOAD(var) memcpy(&(var), p, sizeof(var)); p += sizeof(var);
+
+size_t State_Size();
+void State_Save(u8 *buf);
+bool State_Load(const u8 *buf, size_t len);
+bool State_SaveFile(const char *path);
+bool State_LoadFile(const char *path);
+
+#endif
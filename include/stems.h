@@ -0,0 +1,30 @@
+/*
+ * stems.h
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Header for the audio stem capture.
+ */
+
+#ifndef _STEMS_H
+#define _STEMS_H
+
+#include <utils.h>
+
+// order of the channels in each captured frame
+enum stem_channel {
+    STEM_PULSE1 = 0,
+    STEM_PULSE2,
+    STEM_TRIANGLE,
+    STEM_NOISE,
+    STEM_DMC,
+    STEM_MIX,
+    STEM_CHANNELS,
+};
+
+void Stems_Open(const char *path, int sample_rate);
+void Stems_Push(const float frame[STEM_CHANNELS]);
+void Stems_Close();
+
+#endif
@@ -36,6 +36,8 @@ void Neslog_Free();
 void Utils_SetExitHandler(void (*func)(int));
 void Utils_ExitWithHandler(int rc);
 unsigned char Utils_FlipByte(unsigned char b);
+u64 Utils_Hash64(const void *data, size_t len, u64 seed);
+u32 Utils_Crc32(const void *data, size_t len, u32 crc);
 char* op_to_str(u8 opcode);
 
 // error codes
@@ -1,35 +1,30 @@
 /*
- * periphs.h
+ * vac.h
  *
  * Travis Banken
  * 2020
  *
- * Header for the wrapper framework for Video, Audio, and Controller
+ * Header for the wrapper framework for Video, Audio, and Controller. The
+ * actual work is done by one of the backends (see vac_backends.h).
  */
 
 #ifndef _VAC_H
 #define _VAC_H
 
 #include <utils.h>
-
-typedef struct nes_color
-{
-    u8 red;
-    u8 green;
-    u8 blue;
-} nes_color_t;
+#include <libnes.h>
 
 enum nes_keycode
 {
     // Controller inputs
-    KEY_RIGHT = (1 << 0),
-    KEY_LEFT = (1 << 1),
-    KEY_DOWN = (1 << 2),
-    KEY_UP = (1 << 3),
-    KEY_START = (1 << 4),
-    KEY_SELECT = (1 << 5),
-    KEY_B = (1 << 6),
-    KEY_A = (1 << 7),
+    KEY_RIGHT = NES_RIGHT,
+    KEY_LEFT = NES_LEFT,
+    KEY_DOWN = NES_DOWN,
+    KEY_UP = NES_UP,
+    KEY_START = NES_START,
+    KEY_SELECT = NES_SELECT,
+    KEY_B = NES_B,
+    KEY_A = NES_A,
     // DEBUG
     KEY_PAUSE = (1 << 8),
     KEY_STEP = (1 << 9),
@@ -43,20 +38,43 @@ enum nes_keycode
     KEY_MUTE_3 = (1 << 16),
     KEY_MUTE_4 = (1 << 17),
     KEY_MUTE_5 = (1 << 18),
+    // Window closed
+    KEY_QUIT = (1 << 19),
+    KEY_TURBO = (1 << 20),
+    KEY_SAVE_STATE = (1 << 21),
+    KEY_LOAD_STATE = (1 << 22),
+    KEY_REWIND = (1 << 23),
 };
 
-void Vac_Init(const char *title, bool debug_display);
+enum vac_backend {
+    VAC_SDL,   // window, audio device and keyboard
+    VAC_NULL,  // nothing shown or played, scripted input, virtual clock
+    VAC_FILE,  // like null, but raw frames and audio are written to disk
+};
+
+typedef struct vac_config {
+    enum vac_backend backend;
+    const char *title;
+    bool debug_display;
+    bool vsync;
+    const char *input_script; // null/file: "<frame> <keys...>" lines, may be NULL
+    const char *out_prefix;   // file: writes <prefix>.rgb and <prefix>.f32
+} vac_config_t;
+
+void Vac_Init(const vac_config_t *cfg);
 void Vac_Free();
-void Vac_Refresh();
+bool Vac_Refresh(bool always);
 u32 Vac_Poll();
-void Vac_SetPx(int x, int y, nes_color_t color);
+u32 Vac_Keys();
+void Vac_PublishFrame(const nes_color_t *frame, u64 hash);
 void Vac_SetPxPt(int table_side, u16 x, u16 y, nes_color_t color);
 void Vac_SetPxNt(int table_side, u16 x, u16 y, nes_color_t color);
-void Vac_ClearScreen();
 unsigned int Vac_MsPassedFrom(unsigned int from);
 unsigned int Vac_Now();
 bool Vac_OneSecPassed();
 void Vac_Delay(unsigned int ms);
+u64 Vac_NowNs();
+void Vac_DelayNs(u64 ns);
 void Vac_SetWindowTitle(const char *title);
 void Vac_QueueAudio(const void *data, uint32_t len);
 
@@ -0,0 +1,61 @@
+/*
+ * vac_backends.h
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Header file for all the vac backends.
+ */
+
+#ifndef _VAC_BACKENDS_H
+#define _VAC_BACKENDS_H
+
+#include <utils.h>
+#include <vac.h>
+
+typedef void (*vac_init_t)(const vac_config_t*);
+typedef void (*vac_free_t)(void);
+typedef bool (*vac_refresh_t)(bool);
+typedef u32 (*vac_keys_t)(void);
+typedef void (*vac_publish_t)(const nes_color_t*, u64);
+typedef void (*vac_setpx_t)(int, u16, u16, nes_color_t);
+typedef u64 (*vac_now_t)(void);
+typedef void (*vac_delay_t)(u64);
+typedef void (*vac_title_t)(const char*);
+typedef void (*vac_audio_t)(const void*, uint32_t);
+
+// SDL
+void VacSdl_Init(const vac_config_t *cfg);
+void VacSdl_Free();
+bool VacSdl_Refresh(bool always);
+u32 VacSdl_Poll();
+u32 VacSdl_Keys();
+void VacSdl_PublishFrame(const nes_color_t *frame, u64 hash);
+void VacSdl_SetPxPt(int table_side, u16 x, u16 y, nes_color_t color);
+void VacSdl_SetPxNt(int table_side, u16 x, u16 y, nes_color_t color);
+u64 VacSdl_NowNs();
+void VacSdl_DelayNs(u64 ns);
+void VacSdl_SetWindowTitle(const char *title);
+void VacSdl_QueueAudio(const void *data, uint32_t len);
+
+// Null
+void VacNull_Init(const vac_config_t *cfg);
+void VacNull_Free();
+bool VacNull_Refresh(bool always);
+u32 VacNull_Poll();
+u32 VacNull_Keys();
+void VacNull_PublishFrame(const nes_color_t *frame, u64 hash);
+void VacNull_SetPxPt(int table_side, u16 x, u16 y, nes_color_t color);
+void VacNull_SetPxNt(int table_side, u16 x, u16 y, nes_color_t color);
+u64 VacNull_NowNs();
+void VacNull_DelayNs(u64 ns);
+void VacNull_SetWindowTitle(const char *title);
+void VacNull_QueueAudio(const void *data, uint32_t len);
+
+// File (everything else is shared with Null)
+void VacFile_Init(const vac_config_t *cfg);
+void VacFile_Free();
+void VacFile_PublishFrame(const nes_color_t *frame, u64 hash);
+void VacFile_QueueAudio(const void *data, uint32_t len);
+
+#endif
@@ -28,6 +28,9 @@ static void mode_indx(u8 *fetch, u16 *from);
 static int mode_indy(u8 *fetch, u16 *from);
 static void mode_ind(u16 *fetch);
 
+// interrupts
+static int irq();
+
 // intruction handlers
 static int undef();
 static int adc();
@@ -13,8 +13,11 @@
 
 #include <utils.h>
 #include <apu.h>
-#include <vac.h>
 #include <cpu.h>
+#include <mem.h>
+#include <scheduler.h>
+#include <stems.h>
+#include <state.h>
 
 #define CHECK_INIT if(!is_init){ERROR("Not Initialized!\n"); EXIT(1);}
 
@@ -37,13 +40,24 @@ enum APU_FLAGS {
     FLAGS_FRAME_INT = 1 << 6,
     FLAGS_DMC_INT   = 1 << 7,
 };
-static u8 apuflags = 0;
+static _Thread_local u8 apuflags = 0;
 
 // Frame Counter flags
 #define COUNTER_4STEP 0
 #define COUNTER_5STEP 1
-static u8 counter_mode = 0;
-static bool irq_disabled = false;
+static _Thread_local u8 counter_mode = 0;
+static _Thread_local bool irq_disabled = false;
+static _Thread_local bool frame_irq = false;
+
+// frame counter sequence in cpu cycles, relative to the last $4017 write
+// (magic numbers from here: https://wiki.nesdev.com/w/index.php/APU_Frame_Counter)
+#define FRAME_STEPS 5
+static const u32 frame_step_cycles[2][FRAME_STEPS] = {
+    [COUNTER_4STEP] = {7457, 14913, 22371, 29829, 29830},
+    [COUNTER_5STEP] = {7457, 14913, 22371, 29829, 37282},
+};
+static _Thread_local u64 frame_start = 0;
+static _Thread_local int frame_step = 0;
 
 
 // structure of a pulse wave channel
@@ -66,7 +80,7 @@ typedef struct pulse_channel {
     // helper
     int warm_up;
 } pulse_channel_t;
-static pulse_channel_t pulse[2] = {0};
+static _Thread_local pulse_channel_t pulse[2] = {0};
 
 typedef struct triangle_channel {
     bool enabled;
@@ -82,7 +96,7 @@ typedef struct triangle_channel {
     int warm_up;
     int warm_up_step;
 } triangle_channel_t;
-static triangle_channel_t triangle;
+static _Thread_local triangle_channel_t triangle;
 
 typedef struct noise_channel {
     bool enabled;
@@ -95,9 +109,49 @@ typedef struct noise_channel {
     u16 shift_reg;
 
 } noise_channel_t;
-static noise_channel_t noise;
+static _Thread_local noise_channel_t noise;
+
+// dmc periods in cpu cycles (NTSC)
+static const u16 dmc_rate_table[] = {
+    428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106,  84,  72,  54
+};
 
-static bool is_init = false;
+typedef struct dmc_channel {
+    bool mute;
+    bool irq_enabled;
+    bool irq_flag;
+    bool loop;
+    u16 rate;
+    u8 level;
+    // memory reader
+    u16 sample_addr;
+    u16 sample_len;
+    u16 cur_addr;
+    u16 bytes_remaining;
+    u8 buffer;
+    bool buffer_full;
+    // output unit
+    bool running;
+    bool silence;
+    u8 shift_reg;
+    u8 bits_remaining;
+    u64 next_clock;
+} dmc_channel_t;
+static _Thread_local dmc_channel_t dmc;
+
+// position within the current output sample (in apu cycles)
+static _Thread_local int sample_cycle = 0;
+
+#define APU_STATE(X) \
+    X(apuflags) X(counter_mode) X(irq_disabled) X(frame_irq) \
+    X(frame_start) X(frame_step) \
+    X(pulse) X(triangle) X(noise) X(dmc) X(sample_cycle)
+
+static _Thread_local bool is_init = false;
+
+// no samples get generated or queued while off (frames that will be thrown
+// away, see run-ahead)
+static _Thread_local bool output_on = true;
 
 // the higher the number, the better the approximation to square wave
 #define SQR_ITER 20
@@ -106,9 +160,11 @@ static bool is_init = false;
 #define CPU_CLOCK_RATE 1789773
 #define PI 3.14159265f
 
-// audio buffer
-#define AUDIO_BUFFER_SIZE 4096 // Keep in mind the num samples def in vac.c
-static float audio_buf[AUDIO_BUFFER_SIZE];
+// samples made since the last Apu_ClearSamples, a frame is ~735 of them.
+// anything past the end is dropped.
+#define AUDIO_BUFFER_SIZE 4096
+static _Thread_local float audio_buf[AUDIO_BUFFER_SIZE];
+static _Thread_local size_t abuf_cursor = 0;
 
 // fast sine approx as described here:
 // https://www.youtube.com/watch?v=1xlCVBIF_ig
@@ -208,6 +264,221 @@ static float gen_noise_sample()
     return res;
 }
 
+// *** DMC ***
+// The memory reader steals cycles from the cpu to refill the sample buffer.
+// Refills only happen at the end of an output cycle (8 output clocks), so
+// instead of clocking the dmc every cycle we schedule an event for the end of
+// each output cycle. The output level in between is caught up lazily.
+static void dmc_fetch()
+{
+    if (dmc.buffer_full || dmc.bytes_remaining == 0) {
+        return;
+    }
+
+    // cpu is stalled while the dmc reads from memory
+    Cpu_Stall(4);
+    dmc.buffer = Mem_CpuRead(dmc.cur_addr);
+    dmc.buffer_full = true;
+    dmc.cur_addr = dmc.cur_addr == 0xFFFF ? 0x8000 : dmc.cur_addr + 1;
+    dmc.bytes_remaining--;
+
+    if (dmc.bytes_remaining == 0) {
+        if (dmc.loop) {
+            dmc.cur_addr = dmc.sample_addr;
+            dmc.bytes_remaining = dmc.sample_len;
+        } else if (dmc.irq_enabled) {
+            dmc.irq_flag = true;
+            Cpu_SetIrq(IRQ_APU_DMC);
+        }
+    }
+}
+
+static void dmc_clock()
+{
+    if (!dmc.silence) {
+        if (dmc.shift_reg & 0x1) {
+            if (dmc.level <= 125) {
+                dmc.level += 2;
+            }
+        } else if (dmc.level >= 2) {
+            dmc.level -= 2;
+        }
+        dmc.shift_reg >>= 1;
+    }
+
+    dmc.bits_remaining--;
+    if (dmc.bits_remaining == 0) {
+        // start a new output cycle
+        dmc.bits_remaining = 8;
+        if (dmc.buffer_full) {
+            dmc.silence = false;
+            dmc.shift_reg = dmc.buffer;
+            dmc.buffer_full = false;
+            dmc_fetch();
+        } else {
+            dmc.silence = true;
+            // nothing left to play, stop clocking until restarted
+            dmc.running = dmc.bytes_remaining > 0;
+        }
+    }
+}
+
+static void dmc_catch_up(u64 now)
+{
+    while (dmc.running && dmc.next_clock <= now) {
+        dmc_clock();
+        dmc.next_clock += dmc.rate;
+    }
+}
+
+static void dmc_schedule()
+{
+    if (dmc.running) {
+        // last clock of this output cycle
+        Sched_Add(EV_APU_DMC, dmc.next_clock + (u64)(dmc.bits_remaining - 1) * dmc.rate);
+    } else {
+        Sched_Cancel(EV_APU_DMC);
+    }
+}
+
+static void dmc_event(u64 when)
+{
+    dmc_catch_up(when);
+    dmc_schedule();
+}
+
+static void dmc_start()
+{
+    dmc_fetch();
+    if (!dmc.running) {
+        dmc.running = true;
+        dmc.next_clock = Sched_Now() + dmc.rate;
+    }
+    dmc_schedule();
+}
+
+static float gen_dmc_sample()
+{
+    dmc_catch_up(Sched_Now());
+    if (dmc.mute) {
+        return 0.0f;
+    }
+    return MASTER_VOLUME * ((float) dmc.level / 64.0f - 1.0f);
+}
+
+// *** FRAME COUNTER ***
+static void quarter_frame()
+{
+    // clock envelope and triangle lin counter
+    // pulse channels
+    for (int channel = 0; channel < 2; channel++) {
+        if (!pulse[channel].const_vol && pulse[channel].volume > 0) {
+            pulse[channel].volume--;
+        }
+    }
+
+    // triangle lin counter
+    if (triangle.reload) {
+        triangle.lin_counter = triangle.lin_counter_reload;
+    } else if (triangle.lin_counter > 0) {
+        triangle.lin_counter--;
+    }
+
+    if (!triangle.halt_counter) {
+        triangle.reload = false;
+    }
+
+    if (!triangle.lin_counter || !triangle.counter) {
+        triangle.enabled = false;
+    }
+}
+
+static void half_frame()
+{
+    // clock len counters and sweep
+    for (int channel = 0; channel < 2; channel++) {
+        if (pulse[channel].counter == 0) {
+            // mute
+            pulse[channel].enabled = false;
+        } else if (!pulse[channel].halt_counter) {
+            pulse[channel].counter--;
+        }
+
+        // sweep
+        if (pulse[channel].sweep.on) {
+            u8 change = pulse[channel].timer >> pulse[channel].sweep.shift;
+            // negate if needed
+            change = pulse[channel].sweep.negate ? ~change + 1 : change;
+            // pulse[0] should use 1's complement for some reason :/
+            if (channel == 0) {
+                change--;
+            }
+            pulse[channel].timer += change;
+
+            // mute channel on big period
+            if (pulse[channel].timer > 0x7FF) {
+                pulse[channel].enabled = false;
+                pulse[channel].counter = 0;
+            }
+        }
+    }
+
+    // noise counter
+    if (noise.counter == 0) {
+        // mute
+        noise.enabled = false;
+    } else if (!noise.halt_counter) {
+        noise.counter--;
+    }
+
+    if (!triangle.lin_counter || !triangle.counter) {
+        triangle.enabled = false;
+    }
+}
+
+static void frame_event(u64 when)
+{
+    switch (frame_step) {
+    case 0:
+    case 2:
+        quarter_frame();
+        break;
+    case 1:
+        quarter_frame();
+        half_frame();
+        break;
+    case 3:
+        if (counter_mode == COUNTER_4STEP) {
+            quarter_frame();
+            half_frame();
+            if (!irq_disabled) {
+                frame_irq = true;
+                Cpu_SetIrq(IRQ_APU_FRAME);
+            }
+        }
+        break;
+    case 4:
+        if (counter_mode == COUNTER_5STEP) {
+            quarter_frame();
+            half_frame();
+        }
+        // sequence wraps around
+        frame_start = when;
+        frame_step = -1;
+        break;
+    }
+
+    frame_step++;
+    Sched_Add(EV_APU_FRAME, frame_start + frame_step_cycles[counter_mode][frame_step]);
+}
+
+static void frame_counter_restart(u64 now)
+{
+    frame_start = now;
+    frame_step = 0;
+    Sched_Add(EV_APU_FRAME, frame_start + frame_step_cycles[counter_mode][0]);
+}
+
 void Apu_Init()
 {
     is_init = true;
@@ -215,6 +486,9 @@ void Apu_Init()
     // setup audio callback
     // Vac_SetAudioCallback(audio_callback);
 
+    Sched_Register(EV_APU_FRAME, frame_event);
+    Sched_Register(EV_APU_DMC, dmc_event);
+
     Apu_Reset();
 }
 
@@ -224,6 +498,8 @@ void Apu_Reset()
     CHECK_INIT
 #endif
     apuflags = 0;
+    sample_cycle = 0;
+    output_on = true;
 
     // reset channels
     memset(&pulse[0], 0, sizeof(pulse_channel_t));
@@ -231,6 +507,18 @@ void Apu_Reset()
     memset(&triangle, 0, sizeof(triangle_channel_t));
     memset(&noise, 0, sizeof(noise_channel_t));
     noise.shift_reg = 0x01;
+    memset(&dmc, 0, sizeof(dmc_channel_t));
+    dmc.rate = dmc_rate_table[0];
+    dmc.bits_remaining = 8;
+    dmc.silence = true;
+    Sched_Cancel(EV_APU_DMC);
+
+    // frame counter starts running at power up
+    counter_mode = COUNTER_4STEP;
+    irq_disabled = false;
+    frame_irq = false;
+    Cpu_ClearIrq(IRQ_APU_FRAME | IRQ_APU_DMC);
+    frame_counter_restart(Sched_Now());
 
     // TODO: Turn off channels while figuring this out...
     // pulse[0].mute = true;
@@ -238,30 +526,17 @@ void Apu_Reset()
     // triangle.mute = true;
     noise.mute = true;
 
-    // reset ring buffer
-    memset(audio_buf, 0, AUDIO_BUFFER_SIZE * sizeof(float));
+    // reset sample buffer
+    abuf_cursor = 0;
 }
 
-void Apu_Step(int cycle_budget, u32 keystate)
+void Apu_Step(int cycle_budget)
 {
 #ifdef DEBUG
     CHECK_INIT
 #endif
-    // debug mute channels
-    static unsigned int last_ms = 0;
-    if (Vac_MsPassedFrom(last_ms) >= 200) {
-        if (keystate & KEY_MUTE_1) {
-            pulse[0].mute = !pulse[0].mute;
-            last_ms = Vac_Now();
-        }
-        if (keystate & KEY_MUTE_2) {
-            pulse[1].mute = !pulse[1].mute;
-            last_ms = Vac_Now();
-        }
-        if (keystate & KEY_MUTE_3) {
-            triangle.mute = !triangle.mute;
-            last_ms = Vac_Now();
-        }
+    if (!output_on) {
+        return;
     }
 
     // The cpu clocks at about 1.789 Mhz (cycles per sec)
@@ -269,111 +544,97 @@ void Apu_Step(int cycle_budget, u32 keystate)
     // Thus we need 1.789 / .0441 = 40.5 (cycles per sample)
     // The APU runs about half the speed so we really need 40.5 / 2 cycles per sample
     // So about every 41 cycles or so we generate a sample 
-    // and add it to the ring buffer
+    // and add it to the sample buffer
     // Thanks to this nesdev post for the strategy:
     // https://forums.nesdev.com/viewtopic.php?f=5&t=15383
+    // NOTE: the frame counter and dmc are driven by the scheduler (see
+    // frame_event and dmc_event), this loop only generates samples.
 
-    // state vars
-    static int cycle = 0;
-
-    int abuf_cursor = 0;
     for (int i = 0; i < cycle_budget; i++) {
-        if (cycle % 20 == 0) {
+        if (sample_cycle % 20 == 0) {
+            float stems[STEM_CHANNELS];
+            stems[STEM_PULSE1]   = gen_pulse_sample(0);
+            stems[STEM_PULSE2]   = gen_pulse_sample(1);
+            stems[STEM_TRIANGLE] = gen_triangle_sample();
+            stems[STEM_NOISE]    = gen_noise_sample();
+            stems[STEM_DMC]      = gen_dmc_sample();
             float sample = 0;
-            sample += gen_pulse_sample(0);
-            sample += gen_pulse_sample(1);
-            sample += gen_triangle_sample();
-            sample += gen_noise_sample();
-            audio_buf[abuf_cursor] = sample;
-            abuf_cursor++;
-            if (abuf_cursor >= AUDIO_BUFFER_SIZE) {
-                ERROR("Out of AUDIO Buffer!");
-                EXIT(1);
+            for (int ch = 0; ch < STEM_MIX; ch++) {
+                sample += stems[ch];
+            }
+            stems[STEM_MIX] = sample;
+            Stems_Push(stems);
+            if (abuf_cursor < AUDIO_BUFFER_SIZE) {
+                audio_buf[abuf_cursor++] = sample;
             }
         }
 
-        // quarter frame
-        if (cycle == 3728 || cycle == 7456 || cycle == 11185 || cycle == 14914 || cycle == 18640) {
-            // clock envelope and triangle lin counter
-            if (!(cycle == 14914 && counter_mode == COUNTER_5STEP)) {
-                // pulse channels
-                for (int channel = 0; channel < 2; channel++) {
-                    if (!pulse[channel].const_vol && pulse[channel].volume > 0) {
-                        pulse[channel].volume--;
-                    }
-                }
-
-                // triangle lin counter
-                if (triangle.reload) {
-                    triangle.lin_counter = triangle.lin_counter_reload;
-                } else if (triangle.lin_counter > 0) {
-                    triangle.lin_counter--;
-                }
-
-                if (!triangle.halt_counter) {
-                    triangle.reload = false;
-                }
-            }
+        sample_cycle = (sample_cycle + 1) % 20;
+    }
+}
 
-            // half frame
-            if (cycle == 7456 || (cycle == 14914 && counter_mode == COUNTER_4STEP) 
-                || (cycle == 18640 && counter_mode == COUNTER_5STEP)) {
-                // clock len counters and sweep
-                for (int channel = 0; channel < 2; channel++) {
-                    if (pulse[channel].counter == 0) {
-                        // mute
-                        pulse[channel].enabled = false;
-                    } else if (!pulse[channel].halt_counter) {
-                        pulse[channel].counter--;
-                    }
-
-                    // sweep
-                    if (pulse[channel].sweep.on) {
-                        u8 change = pulse[channel].timer >> pulse[channel].sweep.shift;
-                        // negate if needed
-                        change = pulse[channel].sweep.negate ? ~change + 1 : change;
-                        // pulse[0] should use 1's complement for some reason :/
-                        if (channel == 0) {
-                            change--;
-                        }
-                        pulse[channel].timer += change;
-
-                        // mute channel on big period
-                        if (pulse[channel].timer > 0x7FF) {
-                            pulse[channel].enabled = false;
-                            pulse[channel].counter = 0;
-                        }
-                    }
-                }
-
-                // noise counter
-                if (noise.counter == 0) {
-                    // mute
-                    noise.enabled = false;
-                } else if (!noise.halt_counter) {
-                    noise.counter--;
-                }
-            }
+// mono samples at APU_SAMPLE_RATE made since the last clear
+const float *Apu_Samples(size_t *count)
+{
+    *count = abuf_cursor;
+    return audio_buf;
+}
 
-            if (!triangle.lin_counter || !triangle.counter) {
-                triangle.enabled = false;
-            }
+void Apu_ClearSamples()
+{
+    abuf_cursor = 0;
+}
 
-            if (cycle == 14914 && COUNTER_4STEP && !irq_disabled) {
-                ERROR("HEY THIS HAS AN INTERRUPT REMEMBER TO COME AND IMPLEMENT THIS\n");
-                EXIT(1);
-                Cpu_Irq();
-            }
-        }
+// debug mute, channel is one of the stem channels (not the mix)
+void Apu_ToggleMute(int channel)
+{
+    switch (channel) {
+    case STEM_PULSE1:
+        pulse[0].mute = !pulse[0].mute;
+        break;
+    case STEM_PULSE2:
+        pulse[1].mute = !pulse[1].mute;
+        break;
+    case STEM_TRIANGLE:
+        triangle.mute = !triangle.mute;
+        break;
+    case STEM_NOISE:
+        noise.mute = !noise.mute;
+        break;
+    case STEM_DMC:
+        dmc.mute = !dmc.mute;
+        break;
+    }
+}
+
+void Apu_SetOutput(bool on)
+{
+    output_on = on;
+}
 
+// *** SAVE STATES ***
+size_t Apu_StateSize()
+{
+    return 0 APU_STATE(STATE_SIZE);
+}
 
-        // increment cycle (magic numbers from here: 
-        // https://wiki.nesdev.com/w/index.php/APU_Frame_Counter)
-        cycle = (cycle + 1) % (counter_mode == COUNTER_5STEP ? 18640 : 14914);
-    }
+u8 *Apu_SaveState(u8 *p)
+{
+    APU_STATE(STATE_SAVE)
+    return p;
+}
 
-    // queue audio samples
-    Vac_QueueAudio(audio_buf, abuf_cursor * sizeof(float));
+const u8 *Apu_LoadState(const u8 *p)
+{
+    // channel mutes are a user setting, not machine state
+    bool mutes[5] = {pulse[0].mute, pulse[1].mute, triangle.mute, noise.mute, dmc.mute};
+    APU_STATE(STATE_LOAD)
+    pulse[0].mute = mutes[0];
+    pulse[1].mute = mutes[1];
+    triangle.mute = mutes[2];
+    noise.mute = mutes[3];
+    dmc.mute = mutes[4];
+    return p;
 }
 
 u8 Apu_Read(u16 addr)
@@ -387,10 +648,14 @@ u8 Apu_Read(u16 addr)
     case 0x4015: // Status Flags
         if (pulse[0].counter > 0) data |= FLAGS_PULSE1;
         if (pulse[1].counter > 0) data |= FLAGS_PULSE2;
-        // TODO: Triangle, Noise, DMC
+        // TODO: Triangle, Noise
+        if (dmc.bytes_remaining > 0) data |= FLAGS_DMC;
+        if (frame_irq) data |= FLAGS_FRAME_INT;
+        if (dmc.irq_flag) data |= FLAGS_DMC_INT;
 
         // clear frame interrupt flag
-        apuflags &= ~FLAGS_FRAME_INT;
+        frame_irq = false;
+        Cpu_ClearIrq(IRQ_APU_FRAME);
         break;
     default:
         WARNING("Read support not available for $%04X\n", addr);
@@ -480,6 +745,28 @@ void Apu_Write(u8 data, u16 addr)
         noise.counter = (data >> 3) & 0x1F;
         noise.enabled = true;
         break;
+    case 0x4010: // DMC
+        dmc.irq_enabled = (data & 0x80) != 0;
+        dmc.loop = (data & 0x40) != 0;
+        if (!dmc.irq_enabled) {
+            dmc.irq_flag = false;
+            Cpu_ClearIrq(IRQ_APU_DMC);
+        }
+        // clocks already due use the old rate
+        dmc_catch_up(Sched_Now());
+        dmc.rate = dmc_rate_table[data & 0x0F];
+        dmc_schedule();
+        break;
+    case 0x4011: // DMC
+        dmc_catch_up(Sched_Now());
+        dmc.level = data & 0x7F;
+        break;
+    case 0x4012: // DMC
+        dmc.sample_addr = 0xC000 + ((u16) data << 6);
+        break;
+    case 0x4013: // DMC
+        dmc.sample_len = ((u16) data << 4) + 1;
+        break;
     case 0x4015: // Status Flags
         apuflags = data;
         if (!(apuflags & FLAGS_PULSE1)) {
@@ -498,13 +785,31 @@ void Apu_Write(u8 data, u16 addr)
             // TODO: silence noise
             noise.enabled = false;
         }
+        dmc.irq_flag = false;
+        Cpu_ClearIrq(IRQ_APU_DMC);
         if (!(apuflags & FLAGS_DMC)) {
-            // TODO: silence DMC
+            // sample finishes playing what is already buffered
+            dmc.bytes_remaining = 0;
+        } else if (dmc.bytes_remaining == 0) {
+            // restart sample
+            dmc.cur_addr = dmc.sample_addr;
+            dmc.bytes_remaining = dmc.sample_len;
+            dmc_start();
         }
         break;
     case 0x4017: // Frame Counter
         irq_disabled = (data & 0x40) != 0;
         counter_mode = (data & 0x80) ? COUNTER_5STEP : COUNTER_4STEP;
+        if (irq_disabled) {
+            frame_irq = false;
+            Cpu_ClearIrq(IRQ_APU_FRAME);
+        }
+        // 5-step mode clocks everything right away
+        if (counter_mode == COUNTER_5STEP) {
+            quarter_frame();
+            half_frame();
+        }
+        frame_counter_restart(Sched_Now());
         break;
     default:
         WARNING("Write support not available for $%04X\n", addr);
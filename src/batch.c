@@ -0,0 +1,439 @@
+/*
+ * batch.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * nes-batch: headless runner for many rom/movie pairs at once.
+ *
+ * usage: nes-batch [-j workers] [-o report.json] <manifest>
+ *
+ * Every manifest line is "<rom> <movie|-> <frames> <expected|->" where
+ * expected is either the 16 hex digit hash of the last frame or the path to
+ * a hash stream written by nes --hash-out (then the first diverging frame is
+ * reported too). Blank lines and lines starting with '#' are skipped.
+ *
+ * Jobs run on a work-stealing pool: each worker owns a deque of jobs, takes
+ * from its own end and steals from the other end of someone else's once it
+ * runs dry. libnes state is per thread, so every worker thread is its own
+ * independent console.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <utils.h>
+#include <libnes.h>
+#include <movie.h>
+
+#define NES_FPS 60.0988
+#define MAX_PATH_LEN 1024
+
+typedef struct job {
+    // from the manifest
+    char rom[MAX_PATH_LEN];
+    char movie[MAX_PATH_LEN];     // empty if none
+    char expected[MAX_PATH_LEN];  // hash, golden stream path or empty
+    u32 frames;
+
+    // results
+    u32 frames_run;
+    double seconds;
+    u64 last_hash;
+    bool checked;
+    bool pass;
+    long divergence;              // first frame not matching, -1 if none
+    int worker;
+    const char *error;
+} job_t;
+
+typedef struct worker {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int *deque;   // job indices
+    int top;      // thieves take from here
+    int bottom;   // owner pushes and pops here
+    int id;
+} worker_t;
+
+static job_t *jobs = NULL;
+static int num_jobs = 0;
+static worker_t *workers = NULL;
+static int num_workers = 0;
+
+// *** WORK STEALING ***
+static int pop_own(worker_t *w)
+{
+    int job = -1;
+    pthread_mutex_lock(&w->lock);
+    if (w->bottom > w->top) {
+        job = w->deque[--w->bottom];
+    }
+    pthread_mutex_unlock(&w->lock);
+    return job;
+}
+
+static int steal(worker_t *thief)
+{
+    for (int i = 1; i < num_workers; i++) {
+        worker_t *victim = &workers[(thief->id + i) % num_workers];
+        int job = -1;
+        pthread_mutex_lock(&victim->lock);
+        if (victim->bottom > victim->top) {
+            job = victim->deque[victim->top++];
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (job >= 0) {
+            return job;
+        }
+    }
+    return -1;
+}
+
+// *** RUNNING JOBS ***
+static u64 now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// loads a --hash-out stream, returns the number of hashes read
+static u32 load_golden(const char *path, u64 **hashes)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    u32 cap = 1024;
+    u32 n = 0;
+    u64 *buf = malloc(cap * sizeof(u64));
+    unsigned int frame;
+    uint64_t hash;
+    while (buf != NULL && fscanf(file, "%u %" SCNx64, &frame, &hash) == 2) {
+        if (frame != n) {
+            break;
+        }
+        if (n == cap) {
+            cap *= 2;
+            buf = realloc(buf, cap * sizeof(u64));
+            if (buf == NULL) {
+                break;
+            }
+        }
+        buf[n++] = hash;
+    }
+    fclose(file);
+    if (buf == NULL) {
+        ERROR("Out of Host Memory!\n");
+        EXIT(1);
+    }
+    *hashes = buf;
+    return n;
+}
+
+static bool parse_hash(const char *s, u64 *hash)
+{
+    if (strlen(s) != 16) {
+        return false;
+    }
+    char *end;
+    *hash = strtoull(s, &end, 16);
+    return *end == '\0';
+}
+
+static void run_job(job_t *job)
+{
+    u64 expected_hash = 0;
+    u64 *golden = NULL;
+    u32 golden_len = 0;
+    if (job->expected[0] != '\0') {
+        job->checked = true;
+        if (!parse_hash(job->expected, &expected_hash)) {
+            golden_len = load_golden(job->expected, &golden);
+            if (golden == NULL) {
+                job->error = "can't open golden hash stream";
+                return;
+            }
+        }
+    }
+
+    u64 start = now_ns();
+    if (job->movie[0] != '\0' && !Movie_Play(job->movie, job->rom)) {
+        free(golden);
+        job->error = "can't play movie";
+        return;
+    }
+    if (!Nes_LoadRomFile(job->rom)) {
+        Movie_Close();
+        free(golden);
+        job->error = "can't load rom";
+        return;
+    }
+
+    for (u32 f = 0; f < job->frames; f++) {
+        Nes_StepFrame();
+        job->last_hash = Nes_HashFrame();
+        if (golden != NULL && job->divergence < 0
+                && (f >= golden_len || golden[f] != job->last_hash)) {
+            job->divergence = f;
+        }
+        job->frames_run++;
+        if (Movie_FrameEnd()) {
+            Nes_Reset();
+        }
+    }
+    Movie_Close();
+    job->seconds = (now_ns() - start) / 1e9;
+
+    if (golden != NULL) {
+        job->pass = job->divergence < 0;
+    } else if (job->checked) {
+        job->pass = job->last_hash == expected_hash;
+    }
+    free(golden);
+}
+
+static void *worker_main(void *arg)
+{
+    worker_t *w = arg;
+
+    // this thread's console
+    Nes_Init();
+
+    int job;
+    while ((job = pop_own(w)) >= 0 || (job = steal(w)) >= 0) {
+        jobs[job].worker = w->id;
+        run_job(&jobs[job]);
+    }
+    return NULL;
+}
+
+// *** MANIFEST AND REPORT ***
+static void read_manifest(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror("fopen");
+        ERROR("Failed to open %s\n", path);
+        EXIT(1);
+    }
+
+    int cap = 64;
+    jobs = calloc(cap, sizeof(job_t));
+    char line[4 * MAX_PATH_LEN];
+    int lineno = 0;
+    while (jobs != NULL && fgets(line, sizeof(line), file) != NULL) {
+        lineno++;
+        char *p = line;
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (*p == '#' || *p == '\n' || *p == '\0') {
+            continue;
+        }
+
+        if (num_jobs == cap) {
+            cap *= 2;
+            jobs = realloc(jobs, cap * sizeof(job_t));
+            if (jobs == NULL) {
+                break;
+            }
+        }
+        job_t *job = &jobs[num_jobs];
+        memset(job, 0, sizeof(job_t));
+        job->divergence = -1;
+        char frames[32];
+        // field widths match MAX_PATH_LEN - 1
+        if (sscanf(p, "%1023s %1023s %31s %1023s", job->rom, job->movie, frames, job->expected) != 4) {
+            ERROR("%s:%d: expected \"<rom> <movie|-> <frames> <expected|->\"\n", path, lineno);
+            EXIT(1);
+        }
+        job->frames = strtoul(frames, NULL, 10);
+        if (strcmp(job->movie, "-") == 0) {
+            job->movie[0] = '\0';
+        }
+        if (strcmp(job->expected, "-") == 0) {
+            job->expected[0] = '\0';
+        }
+        num_jobs++;
+    }
+    fclose(file);
+    if (jobs == NULL) {
+        ERROR("Out of Host Memory!\n");
+        EXIT(1);
+    }
+}
+
+static void json_str(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\') {
+            fprintf(out, "\\%c", *s);
+        } else if ((unsigned char) *s < 0x20) {
+            fprintf(out, "\\u%04x", *s);
+        } else {
+            fputc(*s, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void write_report(FILE *out, double wall)
+{
+    int passed = 0;
+    int failed = 0;
+    u64 total_frames = 0;
+    for (int i = 0; i < num_jobs; i++) {
+        job_t *job = &jobs[i];
+        total_frames += job->frames_run;
+        if (job->error != NULL || (job->checked && !job->pass)) {
+            failed++;
+        } else if (job->checked) {
+            passed++;
+        }
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"workers\": %d,\n", num_workers);
+    fprintf(out, "  \"wall_seconds\": %.3f,\n", wall);
+    fprintf(out, "  \"total_frames\": %" PRIu64 ",\n", (uint64_t) total_frames);
+    fprintf(out, "  \"total_fps\": %.1f,\n", wall > 0 ? total_frames / wall : 0);
+    fprintf(out, "  \"passed\": %d,\n", passed);
+    fprintf(out, "  \"failed\": %d,\n", failed);
+    fprintf(out, "  \"jobs\": [\n");
+    for (int i = 0; i < num_jobs; i++) {
+        job_t *job = &jobs[i];
+        double fps = job->seconds > 0 ? job->frames_run / job->seconds : 0;
+        fprintf(out, "    {\"rom\": ");
+        json_str(out, job->rom);
+        fprintf(out, ", \"movie\": ");
+        if (job->movie[0] != '\0') {
+            json_str(out, job->movie);
+        } else {
+            fprintf(out, "null");
+        }
+        fprintf(out, ", \"frames\": %u, \"frames_run\": %u", job->frames, job->frames_run);
+        fprintf(out, ", \"seconds\": %.3f, \"fps\": %.1f, \"speed\": %.2f", job->seconds, fps, fps / NES_FPS);
+        fprintf(out, ", \"worker\": %d", job->worker);
+        fprintf(out, ", \"last_hash\": \"%016" PRIx64 "\"", (uint64_t) job->last_hash);
+        if (job->error != NULL) {
+            fprintf(out, ", \"pass\": false, \"error\": ");
+            json_str(out, job->error);
+        } else if (job->checked) {
+            fprintf(out, ", \"pass\": %s", job->pass ? "true" : "false");
+        } else {
+            fprintf(out, ", \"pass\": null");
+        }
+        if (job->divergence >= 0) {
+            fprintf(out, ", \"first_divergence\": %ld", job->divergence);
+        } else {
+            fprintf(out, ", \"first_divergence\": null");
+        }
+        fprintf(out, "}%s\n", i + 1 < num_jobs ? "," : "");
+    }
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: nes-batch [-j workers] [-o report.json] <manifest>\n");
+    fprintf(stderr, "manifest lines: <rom> <movie|-> <frames> <last frame hash|golden hash stream|->\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *report_path = NULL;
+    num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+    while ((opt = getopt(argc, argv, "j:o:")) != -1) {
+        switch (opt) {
+        case 'j':
+            num_workers = atoi(optarg);
+            break;
+        case 'o':
+            report_path = optarg;
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (argc - optind != 1 || num_workers < 1) {
+        usage();
+        return 1;
+    }
+
+    read_manifest(argv[optind]);
+    if (num_workers > num_jobs && num_jobs > 0) {
+        num_workers = num_jobs;
+    }
+
+    // deal the jobs out round robin, stealing evens out the rest
+    workers = calloc(num_workers, sizeof(worker_t));
+    if (workers == NULL) {
+        ERROR("Out of Host Memory!\n");
+        EXIT(1);
+    }
+    for (int i = 0; i < num_workers; i++) {
+        workers[i].id = i;
+        workers[i].deque = malloc((num_jobs + 1) * sizeof(int));
+        if (workers[i].deque == NULL) {
+            ERROR("Out of Host Memory!\n");
+            EXIT(1);
+        }
+        pthread_mutex_init(&workers[i].lock, NULL);
+    }
+    for (int i = 0; i < num_jobs; i++) {
+        worker_t *w = &workers[i % num_workers];
+        w->deque[w->bottom++] = i;
+    }
+
+    u64 start = now_ns();
+    for (int i = 0; i < num_workers; i++) {
+        int rc = pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+        if (rc != 0) {
+            ERROR("Failed to start worker thread\n");
+            EXIT(1);
+        }
+    }
+    for (int i = 0; i < num_workers; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    double wall = (now_ns() - start) / 1e9;
+
+    FILE *out = stdout;
+    if (report_path != NULL) {
+        out = fopen(report_path, "w");
+        if (out == NULL) {
+            perror("fopen");
+            ERROR("Failed to open %s\n", report_path);
+            EXIT(1);
+        }
+    }
+    write_report(out, wall);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    int failed = 0;
+    for (int i = 0; i < num_jobs; i++) {
+        if (jobs[i].error != NULL || (jobs[i].checked && !jobs[i].pass)) {
+            failed++;
+        }
+    }
+    for (int i = 0; i < num_workers; i++) {
+        pthread_mutex_destroy(&workers[i].lock);
+        free(workers[i].deque);
+    }
+    free(workers);
+    free(jobs);
+    return failed > 0 ? 1 : 0;
+}
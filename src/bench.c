@@ -0,0 +1,108 @@
+/*
+ * bench.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Microbenchmarks for the hot paths of the core. Loads each rom in turn and
+ * times the cartridge bus (cpu and ppu reads) on their own, then whole
+ * frames. Give it one rom per mapper to compare them.
+ *
+ * usage: nes-bench [-f frames] <rom>...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <libnes.h>
+#include <cart.h>
+
+#define READS (1 << 16)
+#define ROUNDS 512
+
+static u64 now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// addresses a game would hit: mostly code and data in prg-rom, some
+// prg-ram. fixed seed so runs compare.
+static void fill_addrs(u16 *addrs, u16 base, u16 span)
+{
+    u32 seed = 0x2A;
+    for (int i = 0; i < READS; i++) {
+        seed = seed * 1103515245 + 12345;
+        addrs[i] = base + ((seed >> 8) % span);
+    }
+}
+
+static volatile u32 bench_sink;
+
+static double bench_reads(u8 (*read)(u16), const u16 *addrs)
+{
+    u32 sink = 0;
+    u64 start = now_ns();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < READS; i++) {
+            sink += read(addrs[i]);
+        }
+    }
+    u64 ns = now_ns() - start;
+    // keeps the reads from being optimized away
+    bench_sink = sink;
+    return (double) ns / ((double) READS * ROUNDS);
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: nes-bench [-f frames] <rom>...\n");
+}
+
+int main(int argc, char **argv)
+{
+    int frames = 600;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:")) != -1) {
+        switch (opt) {
+        case 'f':
+            frames = atoi(optarg);
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (optind >= argc || frames < 1) {
+        usage();
+        return 1;
+    }
+
+    Nes_Init();
+    static u16 cpu_addrs[READS];
+    static u16 ppu_addrs[READS];
+    fill_addrs(cpu_addrs, 0x6000, 0xA000);
+    fill_addrs(ppu_addrs, 0x0000, 0x2000);
+
+    printf("%-6s %12s %12s %12s %8s  %s\n", "mapper", "cpu ns/read", "ppu ns/read",
+        "us/frame", "fps", "rom");
+    for (int i = optind; i < argc; i++) {
+        if (!Nes_LoadRomFile(argv[i])) {
+            return 1;
+        }
+        double cpu_ns = bench_reads(Cart_CpuRead, cpu_addrs);
+        double ppu_ns = bench_reads(Cart_PpuRead, ppu_addrs);
+
+        u64 start = now_ns();
+        for (int f = 0; f < frames; f++) {
+            Nes_StepFrame();
+        }
+        u64 ns = now_ns() - start;
+        printf("%03u    %12.2f %12.2f %12.2f %8.0f  %s\n", Cart_GetMapperNum(), cpu_ns, ppu_ns,
+            (double) ns / frames / 1000.0, frames * 1e9 / (double) ns, argv[i]);
+    }
+    return 0;
+}
@@ -12,244 +12,416 @@
 
 #include <cart.h>
 #include <mem.h>
+#include <cpu.h>
 #include <mappers.h>
+#include <sav.h>
+#include <romdb.h>
+#include <ines.h>
 
 #define CHECK_INIT if(!is_init){ERROR("Not Initialized!\n"); EXIT(1);}
 
-#define INES_HEADER_SIZE 16
 #define CARTMEM_OFFSET 0x4020
 
-// iNES as describe from nes dev
-// https://wiki.nesdev.com/w/index.php/INES
-typedef struct ines_header {
-    u8 prgrom_banks;  // Bank Size in 16 KB units
-    u8 chrrom_banks;  // Bank Size in 8 KB units
-    u8 prgram_banks;  // PRG RAM size in 8KB units
-    bool battery;     // battery-backed ram present
-    bool trainer;     // 512-byte trainer present
-    u8 mapper_num;    // Cartridge Mapper number
-    enum mirror_mode mirror_mode;
-
-    // Some more stuff but its not important :/
-} ines_header_t;
-static ines_header_t inesh;
-
-// cartridge memory (dynamic memory)
-static u8 *cartmem = NULL;
-static size_t cartmem_size = 0;
-static u8 *chrrom = NULL;
-static size_t chrrom_size = 0;
-// static u8 cartmem[0xBFE0] = {0};
-// static u8 chrrom[(8*1024)] = {0};
-
-static ines_header_t read_ines_header(FILE *file)
+static _Thread_local ines_header_t inesh;
+
+// cartridge memory
+// prg-rom and chr-rom point into the rom image (shared and read only), only
+// the writable parts get memory of their own: $4020-$5FFF (expansion),
+// $6000-$7FFF (prg-ram, the save file's mapping on battery carts) and
+// chr-ram. prg-ram and chr-ram are as big as the header says (rounded up to
+// whole slots), carts without them get none.
+#define PRGRAM_OFFSET 0x6000
+#define EXPRAM_SIZE (PRGRAM_OFFSET - CARTMEM_OFFSET)
+// expansion ram is backed from $4000 so it fills a whole prg slot, the
+// first 0x20 bytes are the apu and io registers and never reach us
+static _Thread_local u8 expram[PRG_SLOT_SIZE];
+static _Thread_local u8 *prgram_buf = NULL;
+static _Thread_local u8 *prgram = NULL; // prgram_buf or the save file
+static _Thread_local size_t prgram_size = 0;
+static _Thread_local const u8 *prgrom = NULL;
+static _Thread_local size_t prgrom_size = 0;
+static _Thread_local u8 *chrram = NULL;
+static _Thread_local size_t chrram_size = 0;
+static _Thread_local const u8 *chrmem = NULL; // chr-rom or chrram
+static _Thread_local size_t chrrom_size = 0;
+// what $6000-$7FFF reads as on carts without prg-ram
+static const u8 no_prgram[PRG_SLOT_SIZE];
+
+// battery save, only used if a save path was given before the load
+static _Thread_local const char *save_path = NULL;
+static _Thread_local sav_file_t *save = NULL;
+static _Thread_local bool save_dirty = false;
+
+// what the cpu and ppu see, published by the mapper. cpu reads are
+// prg_map[addr >> 13][addr & 0x1FFF] and ppu reads
+// chr_map[addr >> 10][addr & 0x3FF]. the w maps are NULL where writes don't
+// land in memory (rom), those go to the mapper's registers instead.
+#define PRG_SLOTS (0x10000 / PRG_SLOT_SIZE)
+#define CHR_SLOTS (0x2000 / CHR_SLOT_SIZE)
+static _Thread_local const u8 *prg_map[PRG_SLOTS];
+static _Thread_local u8 *prg_wmap[PRG_SLOTS];
+static _Thread_local const u8 *chr_map[CHR_SLOTS];
+static _Thread_local u8 *chr_wmap[CHR_SLOTS];
+static _Thread_local enum mirror_mode mirror_mode;
+
+// tiles changed since the last Cart_ChrDirty (one OR per chr write), and
+// what each consumer hasn't collected yet. a chr-ram write only marks the
+// slot it went through, a bank mapped into two slots at once shows up in
+// the one written.
+static _Thread_local u64 chr_dirty[CHR_DIRTY_WORDS];
+static _Thread_local u64 chr_pending[CHR_CONSUMERS][CHR_DIRTY_WORDS];
+
+// rom database to fix headers with, NULL for none
+static _Thread_local const romdb_t *romdb = NULL;
+
+static u32 romdb_ram_size(u8 shift)
 {
-    assert(file != NULL);
-
-    u8 filebuf[INES_HEADER_SIZE];
-    int bytes = fread(filebuf, 1, INES_HEADER_SIZE, file);
-    assert(bytes == INES_HEADER_SIZE);
-
-    // fill ines header
-    int i = 0;
-    ines_header_t header;
-
-    // skip over first 3 bytes (not important)
-    i += 3;
-
-    // check magic number
-    u8 magic_1A = filebuf[i++];
-    assert(magic_1A == 0x1A);
-
-    header.prgrom_banks = filebuf[i++];
-    header.chrrom_banks = filebuf[i++];
-
-    u8 flags6, flags7;
-    flags6 = filebuf[i++];
-    flags7 = filebuf[i++];
-    u8 mirror_v;
-    u8 fourscreen_mir;
-    // fill in flags
-    mirror_v           = (flags6 >> 0) & 0x1;
-    header.battery     = (flags6 >> 1) & 0x1;
-    header.trainer     = (flags6 >> 2) & 0x1;
-    fourscreen_mir     = (flags6 >> 3) & 0x1;
-    header.mapper_num  = (flags6 >> 4) & 0xF;
-    header.mapper_num |= (flags7 & 0xF0);
-    INFO("Mapper Number %03d\n", header.mapper_num);
-
-    // fill in rest of header
-    header.prgram_banks = filebuf[i++];
-
-    // set mirror mode
-    // first check if four screen mode on
-    if (fourscreen_mir) {
-        header.mirror_mode = MIR_4SCRN;
-    } else if (mirror_v) {
-        header.mirror_mode = MIR_VERT;
-    } else {
-        header.mirror_mode = MIR_HORZ;
+    return shift == 0 ? 0 : 64u << shift;
+}
+
+// believe the database over the header for carts it knows
+static void fix_header(ines_header_t *header, const u8 *rom, size_t len)
+{
+    u32 crc = Ines_DataCrc(header, rom, len);
+    const romdb_entry_t *entry = Romdb_Find(romdb, crc);
+    if (entry == NULL) {
+        INFO("Rom %08X is not in the rom database, using its header\n", crc);
+        return;
+    }
+    if (entry->mapper != header->mapper_num || entry->mirror != header->mirror_mode
+            || ((entry->flags & ROMDB_BATTERY) != 0) != header->battery) {
+        WARNING("Header of rom %08X is wrong, using the rom database\n", crc);
     }
+    header->mapper_num = entry->mapper;
+    header->submapper = entry->submapper;
+    header->mirror_mode = entry->mirror;
+    header->battery = (entry->flags & ROMDB_BATTERY) != 0;
+    u32 prgram = romdb_ram_size(entry->prgram);
+    header->prgram_size = header->battery ? 0 : prgram;
+    header->prgnvram_size = header->battery ? prgram : 0;
+    header->chrram_size = romdb_ram_size(entry->chrram);
+    header->chrnvram_size = 0;
+}
 
-    return header;
+// carts loaded from now on are looked up in db (NULL for none)
+void Cart_SetRomDb(const romdb_t *db)
+{
+    romdb = db;
 }
 
-// mapper handlers
-static mapper_wfunc_t map_cpuwrite = NULL;
-static mapper_rfunc_t map_cpuread  = NULL;
-static mapper_wfunc_t map_ppuwrite = NULL;
-static mapper_rfunc_t map_ppuread  = NULL;
-static mapper_mirfunc_t map_getmirrormode = NULL;
-static mapper_init_t map_init      = NULL;
+// the loaded cart's mapper, from the registry
+static _Thread_local const mapper_t *mapper = NULL;
+
+// *** BANK MAPS ***
+// mappers call these from init, register writes and state loads
 
-static void setup_mapper_handlers(u8 mapper_num)
+// map size bytes of prg-rom at cpu addr ($8000-$FFFF), bank counted in units
+// of size. bank numbers past the end wrap like the missing address lines.
+void Cart_MapPrg(u16 addr, u32 size, u32 bank)
 {
-    switch (mapper_num) {
-    case 0:
-        map_init     = Map000_Init;
-        map_cpuwrite = Map000_CpuWrite;
-        map_cpuread  = Map000_CpuRead;
-        map_ppuwrite = Map000_PpuWrite;
-        map_ppuread  = Map000_PpuRead;
-        map_getmirrormode = Map000_GetMirrorMode;
-        break;
-    case 1:
-        map_init     = Map001_Init;
-        map_cpuwrite = Map001_CpuWrite;
-        map_cpuread  = Map001_CpuRead;
-        map_ppuwrite = Map001_PpuWrite;
-        map_ppuread  = Map001_PpuRead;
-        map_getmirrormode = Map001_GetMirrorMode;
-        break;
-    case 2:
-        map_init     = Map002_Init;
-        map_cpuwrite = Map002_CpuWrite;
-        map_cpuread  = Map002_CpuRead;
-        map_ppuwrite = Map002_PpuWrite;
-        map_ppuread  = Map002_PpuRead;
-        map_getmirrormode = Map002_GetMirrorMode;
-        break;
-    default:
-        ERROR("Mapper (%u) not supported!\n", mapper_num);
-        EXIT(1);
+    assert(addr >= 0x8000 && addr % PRG_SLOT_SIZE == 0 && size % PRG_SLOT_SIZE == 0);
+    size_t count = prgrom_size > size ? prgrom_size / size : 1;
+    size_t offset = (bank % count) * size;
+    for (u32 i = 0; i < size; i += PRG_SLOT_SIZE) {
+        prg_map[(addr + i) / PRG_SLOT_SIZE] = prgrom + (offset + i) % prgrom_size;
+    }
+}
+
+// map size bytes of chr-rom/ram at ppu addr ($0000-$1FFF), bank counted in
+// units of size
+void Cart_MapChr(u16 addr, u32 size, u32 bank)
+{
+    assert(addr < 0x2000 && addr % CHR_SLOT_SIZE == 0 && size % CHR_SLOT_SIZE == 0);
+    size_t count = chrrom_size > size ? chrrom_size / size : 1;
+    size_t offset = (bank % count) * size;
+    for (u32 i = 0; i < size; i += CHR_SLOT_SIZE) {
+        size_t slot = (addr + i) / CHR_SLOT_SIZE;
+        const u8 *slot_mem = chrmem + (offset + i) % chrrom_size;
+        if (chr_map[slot] != slot_mem) {
+            chr_map[slot] = slot_mem;
+            chr_dirty[slot] = ~0ULL;
+        }
+        // chr-rom is read only
+        chr_wmap[slot] = chrmem == chrram ? chrram + (offset + i) % chrrom_size : NULL;
     }
 }
 
-static bool is_init = false;
+// MIR_DEFAULT goes back to what the header says. four screen carts bring
+// their own vram, the mapper can't change their mirroring.
+void Cart_SetMirrorMode(enum mirror_mode mode)
+{
+    if (mode == MIR_DEFAULT || inesh.mirror_mode == MIR_4SCRN) {
+        mode = inesh.mirror_mode;
+    }
+    mirror_mode = mode;
+}
+
+// hands who the tiles that changed since its last call
+void Cart_ChrDirty(enum chr_consumer who, u64 dirty[CHR_DIRTY_WORDS])
+{
+    for (int w = 0; w < CHR_DIRTY_WORDS; w++) {
+        for (int c = 0; c < CHR_CONSUMERS; c++) {
+            chr_pending[c][w] |= chr_dirty[w];
+        }
+        chr_dirty[w] = 0;
+        dirty[w] = chr_pending[who][w];
+        chr_pending[who][w] = 0;
+    }
+}
+
+// the ppu is about to move its a12 edges (Changing) and has moved them
+// (Changed), only mappers with a scanline counter care
+void Cart_A12Changing()
+{
+    if (mapper->flags & MAPPER_A12) {
+        mapper->a12changing();
+    }
+}
+
+void Cart_A12Changed()
+{
+    if (mapper->flags & MAPPER_A12) {
+        mapper->a12changed();
+    }
+}
+
+// ram below $8000 is the same for every mapper
+static void map_cartram()
+{
+    prg_map[CARTMEM_OFFSET / PRG_SLOT_SIZE] = expram;
+    prg_wmap[CARTMEM_OFFSET / PRG_SLOT_SIZE] = expram;
+    // without prg-ram writes there go to the mapper, which ignores them
+    prg_map[PRGRAM_OFFSET / PRG_SLOT_SIZE] = prgram != NULL ? prgram : no_prgram;
+    prg_wmap[PRGRAM_OFFSET / PRG_SLOT_SIZE] = prgram;
+}
+
+static _Thread_local bool is_init = false;
 void Cart_Init()
 {
     is_init = true;
 }
 
-void Cart_Reset()
+// registers back to power on, then publish the banks they select
+static void reset_mapper()
 {
-    if (map_init != NULL) {
-        map_init(inesh.prgrom_banks, inesh.chrrom_banks);
+    if (mapper->flags & MAPPER_IRQ) {
+        Cpu_ClearIrq(IRQ_MAPPER);
+    }
+    Cart_SetMirrorMode(MIR_DEFAULT);
+    if (mapper->init != NULL) {
+        // partial banks (exponent sized roms) count as whole ones
+        u16 prgrom_banks = (prgrom_size + PRGROM_BANK_SIZE - 1) / PRGROM_BANK_SIZE;
+        u16 chrrom_banks = (inesh.chrrom_size + CHRROM_BANK_SIZE - 1) / CHRROM_BANK_SIZE;
+        mapper->init(prgrom_banks, chrrom_banks);
     }
-    else {
+    mapper->banks();
+}
+
+void Cart_Reset()
+{
+    if (mapper == NULL) {
         ERROR("Cartridge Reset Failed: No Roms loaded :/\n");
         EXIT(1);
     }
+    reset_mapper();
+}
+
+// battery ram of carts loaded from now on is kept in path (NULL for none)
+void Cart_SetSaveFile(const char *path)
+{
+    save_path = path;
 }
 
-void Cart_Load(const char *path)
+// called on frame boundaries: hand prg-ram writes since the last call on to
+// the disk. the writes themselves never leave the cpu write path.
+void Cart_FlushSave()
+{
+    if (save_dirty && save != NULL) {
+        Sav_Flush(save);
+        save_dirty = false;
+    }
+}
+
+// drop the loaded cart: ram freed, the save written back and no mapper
+static void unload()
+{
+    Sav_Close(save);
+    save = NULL;
+    save_dirty = false;
+    free(prgram_buf);
+    prgram_buf = NULL;
+    prgram = NULL;
+    free(chrram);
+    chrram = NULL;
+    chrram_size = 0;
+    mapper = NULL;
+}
+
+// load an iNES image, the prg and chr banks are used in place so the image
+// must outlive the cartridge (until the next Cart_Load). false if the image
+// can't be loaded, there's no cart afterwards either way.
+bool Cart_Load(const u8 *rom, size_t len)
 {
 #ifdef DEBUG
     CHECK_INIT;
 #endif
 
-    // reset memory
-    if (cartmem != NULL) {
-        free(cartmem);
-        cartmem = NULL;
+    unload();
+    if (!Ines_ReadHeader(rom, len, &inesh)) {
+        return false;
     }
-    if (chrrom != NULL) {
-        free(chrrom);
-        chrrom = NULL;
+    if (romdb != NULL) {
+        fix_header(&inesh, rom, len);
     }
-
-    // load new rom
-    FILE *romfile = fopen(path, "rb");
-    if (romfile == NULL) {
-        perror("fopen");
-        ERROR("Failed to open %s\n", path);
-        EXIT(1);
+    if (inesh.mirror_mode > MIR_4SCRN) {
+        ERROR("Bad mirroring (%u)\n", inesh.mirror_mode);
+        return false;
+    }
+    INFO("Mapper Number %03d.%u%s\n", inesh.mapper_num, inesh.submapper, inesh.nes2 ? " (NES 2.0)" : "");
+    // the trainer sits between the header and prg-rom
+    size_t trainer_size = inesh.trainer ? INES_TRAINER_SIZE : 0;
+    const u8 *data = rom + INES_HEADER_SIZE + trainer_size;
+    size_t data_len = len - INES_HEADER_SIZE >= trainer_size ? len - INES_HEADER_SIZE - trainer_size : 0;
+
+    prgrom_size = inesh.prgrom_size;
+    if (prgrom_size == 0) {
+        ERROR("Rom has no PRG-ROM\n");
+        return false;
+    }
+    chrrom_size = inesh.chrrom_size;
+    if (data_len < prgrom_size || data_len - prgrom_size < chrrom_size) {
+        ERROR("Rom is truncated: header says %lu bytes, got %lu\n",
+            (unsigned long) (INES_HEADER_SIZE + trainer_size + prgrom_size + chrrom_size), (unsigned long) len);
+        return false;
+    }
+    const mapper_t *cart_mapper = Mappers_Get(inesh.mapper_num);
+    if (cart_mapper == NULL) {
+        ERROR("Mapper (%u) not supported!\n", inesh.mapper_num);
+        return false;
     }
 
-    inesh = read_ines_header(romfile);
-    if (inesh.trainer) {
-        // TODO add trainer support ???
-        ERROR("No trainer support :(\n");
-        EXIT(1);
+    // zeroed so power on is the same every run (movies depend on it), only
+    // a battery save keeps its contents
+    memset(expram, 0, sizeof(expram));
+
+    // one prg-ram chip is mapped at $6000, the battery one if there are
+    // both. less than a slot mirrors in real carts, here it's padded.
+    u32 prgram_bytes = inesh.prgnvram_size != 0 ? inesh.prgnvram_size : inesh.prgram_size;
+    if (inesh.prgram_size != 0 && inesh.prgnvram_size != 0) {
+        WARNING("Carts with both PRG-RAM and PRG-NVRAM are not supported, using the PRG-NVRAM\n");
+    }
+    if (inesh.trainer && prgram_bytes == 0) {
+        // the trainer has to go somewhere
+        prgram_bytes = PRG_SLOT_SIZE;
     }
-    if (inesh.battery) {
-        // TODO add save support
-        WARNING("No support for battery-backed RAM! Your game will not be saved!\n");
+    prgram_size = (prgram_bytes + PRG_SLOT_SIZE - 1) / PRG_SLOT_SIZE * PRG_SLOT_SIZE;
+    if (prgram_size > PRG_SLOT_SIZE) {
+        WARNING("Only the first 8 KB of the cart's %lu KB of PRG-RAM is mapped\n",
+            (unsigned long) prgram_size / 1024);
+    }
+    if (prgram_size != 0 && inesh.prgnvram_size != 0 && save_path != NULL) {
+        save = Sav_Open(save_path, prgram_size);
+        if (save != NULL) {
+            prgram = save->data;
+        }
+    }
+    if (prgram_size != 0 && save == NULL) {
+        // no save file asked for, or it couldn't be made: plain ram
+        if (inesh.prgnvram_size != 0) {
+            WARNING("Battery-backed RAM will not be saved!\n");
+        }
+        prgram_buf = calloc(prgram_size, 1);
+        prgram = prgram_buf;
     }
 
-    size_t prgrom_size = inesh.prgrom_banks * PRGROM_BANK_SIZE;
-    assert(prgrom_size != 0);
-    chrrom_size = inesh.chrrom_banks * CHRROM_BANK_SIZE;
+    prgrom = data;
     if (chrrom_size == 0) {
-        // TODO: Figure out CHR-RAM situation
-        INFO("CHR-ROM Bank size is ZERO! Assuming CHR-RAM of 8KB\n");
-        // for now, assume max size??
-        chrrom_size = (8*1024);
+        // chr-ram (battery backed or not, nothing saves it)
+        chrram_size = inesh.chrram_size + inesh.chrnvram_size;
+        if (chrram_size == 0) {
+            WARNING("Cart has neither CHR-ROM nor CHR-RAM, assuming 8 KB of CHR-RAM\n");
+            chrram_size = 8 * 1024;
+        }
+        chrram_size = (chrram_size + CHR_SLOT_SIZE - 1) / CHR_SLOT_SIZE * CHR_SLOT_SIZE;
+        chrram = calloc(chrram_size, 1);
+        chrrom_size = chrram_size;
+        chrmem = chrram;
+    } else {
+        if (inesh.chrram_size + inesh.chrnvram_size != 0) {
+            WARNING("CHR-RAM next to CHR-ROM is not supported\n");
+        }
+        chrmem = prgrom + prgrom_size;
     }
-
-    // initialize memory
-    cartmem_size = prgrom_size + (0x8000 - CARTMEM_OFFSET);
-    cartmem = malloc(cartmem_size);
-    chrrom = malloc(chrrom_size);
-    if (cartmem == NULL || chrrom == NULL) {
+    if ((prgram_size != 0 && prgram == NULL) || (chrrom_size != 0 && chrmem == NULL)) {
         ERROR("Out of Host Memory!\n");
-        EXIT(1);
+        unload();
+        return false;
+    }
+    if (inesh.trainer) {
+        // loaded at $7000 before the game runs
+        INFO("Trainer loaded at $7000\n");
+        memcpy(prgram + 0x1000, rom + INES_HEADER_SIZE, INES_TRAINER_SIZE);
     }
 
-    // write out prg rom
-    fread(&cartmem[0x8000 - CARTMEM_OFFSET], 1, prgrom_size, romfile);
-
-    // may be zero if cart uses chr-ram
-    fread(&chrrom[0], 1, chrrom_size, romfile);
-
-    // init mapper handlers
-    setup_mapper_handlers(inesh.mapper_num);
-    map_init(inesh.prgrom_banks, inesh.chrrom_banks);
+    // init mapper handlers, the mapper fills in the rom part of the maps
+    memset(prg_map, 0, sizeof(prg_map));
+    memset(prg_wmap, 0, sizeof(prg_wmap));
+    memset(chr_map, 0, sizeof(chr_map));
+    memset(chr_wmap, 0, sizeof(chr_wmap));
+    memset(chr_dirty, 0xFF, sizeof(chr_dirty));
+    map_cartram();
+    mapper = cart_mapper;
+    // every mapper publishes bank tables, the bus never calls into it
+    assert(mapper->banks != NULL);
+    assert(!(mapper->flags & MAPPER_A12) || (mapper->a12changing != NULL && mapper->a12changed != NULL));
+    INFO("Mapper: %s\n", mapper->name);
+    reset_mapper();
 
     // TODO the rare extensions
 
-    INFO("PRG-ROM Size: %lu (%lu KB) (%u Banks)\n", prgrom_size, prgrom_size / 1024, inesh.prgrom_banks);
-    INFO("CHR-ROM/RAM Size: %lu (%lu KB)\n", chrrom_size, chrrom_size / 1024);
-    INFO("%s loaded successfully!\n", path);
-    fclose(romfile);
+    INFO("PRG-ROM Size: %lu (%lu KB)\n", prgrom_size, prgrom_size / 1024);
+    INFO("PRG-RAM Size: %lu (%lu KB)%s\n", prgram_size, prgram_size / 1024, save != NULL ? " (saved)" : "");
+    INFO("CHR-%s Size: %lu (%lu KB)\n", chrram != NULL ? "RAM" : "ROM", chrrom_size, chrrom_size / 1024);
+    return true;
 }
 
 u8 Cart_CpuRead(u16 addr)
 {
 #ifdef DEBUG
     CHECK_INIT;
-    assert(map_cpuread != NULL);
+    assert(addr >= CARTMEM_OFFSET && prg_map[addr >> 13] != NULL);
 #endif
-    u32 maddr = addr;
-    bool allowed = map_cpuread(&maddr);
-    if (allowed) {
-        assert((size_t)(maddr - CARTMEM_OFFSET) < cartmem_size);
-        return cartmem[maddr - CARTMEM_OFFSET];
-    }
-    return 0;
+    return prg_map[addr >> 13][addr & (PRG_SLOT_SIZE - 1)];
+}
+
+// the 256 bytes at cpu page hi ($4100 up), NULL if nothing is mapped there.
+// pages never straddle slots.
+const u8 *Cart_CpuPage(u8 hi)
+{
+#ifdef DEBUG
+    CHECK_INIT;
+    assert(hi > 0x40);
+#endif
+    const u8 *bank = prg_map[hi >> 5];
+    return bank != NULL ? bank + ((hi << 8) & (PRG_SLOT_SIZE - 1)) : NULL;
 }
 
 void Cart_CpuWrite(u8 data, u16 addr)
 {
 #ifdef DEBUG
     CHECK_INIT;
-    assert(map_cpuwrite != NULL);
 #endif
-    u32 maddr = addr;
-    bool allowed = map_cpuwrite(data, &maddr);
-    if (allowed) {
-        assert((size_t)(maddr - CARTMEM_OFFSET) < cartmem_size);
-        cartmem[maddr - CARTMEM_OFFSET] = data;
+    u8 *bank = prg_wmap[addr >> 13];
+    if (bank == NULL) {
+        // rom, the mapper's registers live here
+        if (mapper->write != NULL) {
+            mapper->write(data, addr);
+        }
+        return;
+    }
+    bank[addr & (PRG_SLOT_SIZE - 1)] = data;
+    if (bank == prgram) {
+        save_dirty = true;
     }
 }
 
@@ -257,28 +429,22 @@ u8 Cart_PpuRead(u16 addr)
 {
 #ifdef DEBUG
     CHECK_INIT;
-    assert(map_ppuread != NULL);
+    assert(addr < 0x2000 && chr_map[addr >> 10] != NULL);
 #endif
-    u32 maddr = addr;
-    bool allowed = map_ppuread(&maddr);
-    if (allowed) {
-        assert(maddr < chrrom_size);
-        return chrrom[maddr];
-    }
-    return 0;
+    return chr_map[addr >> 10][addr & (CHR_SLOT_SIZE - 1)];
 }
 
 void Cart_PpuWrite(u8 data, u16 addr)
 {
 #ifdef DEBUG
     CHECK_INIT;
-    assert(map_ppuwrite != NULL);
+    assert(addr < 0x2000);
 #endif
-    u32 maddr = addr;
-    bool allowed = map_ppuwrite(data, &maddr);
-    if (allowed) {
-        assert(maddr < chrrom_size);
-        chrrom[maddr] = data;
+    u8 *bank = chr_wmap[addr >> 10];
+    // chr-rom is read only
+    if (bank != NULL) {
+        bank[addr & (CHR_SLOT_SIZE - 1)] = data;
+        chr_dirty[addr >> 10] |= 1ULL << ((addr >> 4) & 63);
     }
 }
 
@@ -287,11 +453,73 @@ inline enum mirror_mode Cart_GetMirrorMode()
 #ifdef DEBUG
     CHECK_INIT;
 #endif
-    enum mirror_mode mm = map_getmirrormode();
-    if (mm == MIR_DEFAULT) {
-        return inesh.mirror_mode;
+    return mirror_mode;
+}
+
+u16 Cart_GetMapperNum()
+{
+#ifdef DEBUG
+    CHECK_INIT;
+#endif
+    return inesh.mapper_num;
+}
+
+// *** SAVE STATES ***
+// only the writable parts of the cartridge: $4020-$7FFF (expansion and
+// prg-ram), chr-ram and the mapper registers
+
+size_t Cart_StateSize()
+{
+#ifdef DEBUG
+    CHECK_INIT;
+#endif
+    size_t mapper_size = mapper->statesize != NULL ? mapper->statesize() : 0;
+    return EXPRAM_SIZE + prgram_size + chrram_size + mapper_size;
+}
+
+u8 *Cart_SaveState(u8 *p)
+{
+#ifdef DEBUG
+    CHECK_INIT;
+#endif
+    memcpy(p, expram + (CARTMEM_OFFSET & (PRG_SLOT_SIZE - 1)), EXPRAM_SIZE);
+    p += EXPRAM_SIZE;
+    if (prgram_size != 0) {
+        memcpy(p, prgram, prgram_size);
+        p += prgram_size;
+    }
+    if (chrram_size != 0) {
+        memcpy(p, chrram, chrram_size);
+        p += chrram_size;
     }
-    return mm;
+    if (mapper->savestate != NULL) {
+        p = mapper->savestate(p);
+    }
+    return p;
+}
+
+const u8 *Cart_LoadState(const u8 *p)
+{
+#ifdef DEBUG
+    CHECK_INIT;
+#endif
+    memcpy(expram + (CARTMEM_OFFSET & (PRG_SLOT_SIZE - 1)), p, EXPRAM_SIZE);
+    p += EXPRAM_SIZE;
+    if (prgram_size != 0) {
+        memcpy(prgram, p, prgram_size);
+        p += prgram_size;
+        save_dirty = true;
+    }
+    if (chrram_size != 0) {
+        memcpy(chrram, p, chrram_size);
+        p += chrram_size;
+    }
+    memset(chr_dirty, 0xFF, sizeof(chr_dirty));
+    if (mapper->loadstate != NULL) {
+        p = mapper->loadstate(p);
+    }
+    mapper->banks();
+    return p;
 }
 
 void Cart_Dump()
@@ -311,10 +539,15 @@ void Cart_Dump()
     fprintf(ofile, "---------------------------------------\n");
     fprintf(ofile, "iNES Header Dump\n");
     fprintf(ofile, "---------------------------------------\n");
+    fprintf(ofile, "NES 2.0: %u\n", inesh.nes2 ? 1 : 0);
     fprintf(ofile, "Mapper Num: %u\n", inesh.mapper_num);
-    fprintf(ofile, "Num PRG-ROM Banks: %u\n", inesh.prgrom_banks);
-    fprintf(ofile, "Num CHR-ROM Banks: %u\n", inesh.chrrom_banks);
-    fprintf(ofile, "Num PRG-RAM Banks: %u\n", inesh.prgram_banks);
+    fprintf(ofile, "Submapper Num: %u\n", inesh.submapper);
+    fprintf(ofile, "PRG-ROM Size: %lu\n", (unsigned long) inesh.prgrom_size);
+    fprintf(ofile, "CHR-ROM Size: %lu\n", (unsigned long) inesh.chrrom_size);
+    fprintf(ofile, "PRG-RAM Size: %lu\n", (unsigned long) inesh.prgram_size);
+    fprintf(ofile, "PRG-NVRAM Size: %lu\n", (unsigned long) inesh.prgnvram_size);
+    fprintf(ofile, "CHR-RAM Size: %lu\n", (unsigned long) inesh.chrram_size);
+    fprintf(ofile, "CHR-NVRAM Size: %lu\n", (unsigned long) inesh.chrnvram_size);
     fprintf(ofile, "*** Flags ***\n");
     fprintf(ofile, "    Mirror Type: %u\n", inesh.mirror_mode == MIR_VERT ? 1 : 0);
     fprintf(ofile, "    4 Screen Mirror: %u\n", inesh.mirror_mode == MIR_4SCRN ? 1 : 0);
@@ -329,7 +562,11 @@ void Cart_Dump()
         ERROR("Failed to dump PRG-ROM\n");
         return;
     }
-    fwrite(cartmem, 1, cartmem_size, ofile);
+    fwrite(expram + (CARTMEM_OFFSET & (PRG_SLOT_SIZE - 1)), 1, EXPRAM_SIZE, ofile);
+    if (prgram != NULL) {
+        fwrite(prgram, 1, prgram_size, ofile);
+    }
+    fwrite(prgrom, 1, prgrom_size, ofile);
     fclose(ofile);
     ofile = NULL;
 
@@ -340,7 +577,7 @@ void Cart_Dump()
         ERROR("Failed to dump CHR-ROM\n");
         return;
     }
-    fwrite(chrrom, 1, chrrom_size, ofile);
+    fwrite(chrmem, 1, chrrom_size, ofile);
     fclose(ofile);
     ofile = NULL;
 }
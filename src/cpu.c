@@ -12,9 +12,13 @@
  * http://obelisk.me.uk/6502/reference.html
  */
 
+#include <pthread.h>
+
 #include <utils.h>
 #include <cpu.h>
 #include <mem.h>
+#include <scheduler.h>
+#include <state.h>
 
 // static function prototypes
 #include "_cpu.h"
@@ -44,8 +48,11 @@ enum psr_flags {
 
 #define NUM_OPS 256
 
+// the same for every console, so one table shared by all threads, set up
+// by the first Cpu_Init
 typedef int(*op_func)();
 static op_func opmatrix[NUM_OPS];
+static pthread_once_t opmatrix_once = PTHREAD_ONCE_INIT;
 
 typedef struct cpu_state {
     // Registers
@@ -59,15 +66,45 @@ typedef struct cpu_state {
     u32 cycle;
     u8 op;
 } cpu_state_t;
-static cpu_state_t state;
-static cpu_state_t prev_state;
+static _Thread_local cpu_state_t state;
+static _Thread_local cpu_state_t prev_state;
 
-static bool is_init = false;
-void Cpu_Init()
+// pending interrupt requests (see enum irq_source) and cycles stolen by dma
+static _Thread_local u8 irq_line;
+static _Thread_local int stall_cycles;
+// an oam dma was started by this instruction's write to $4014
+static _Thread_local bool oam_dma;
+
+#define CPU_STATE(X) X(state) X(irq_line) X(stall_cycles)
+
+// internal ram (Mem_Iram). the zero page and the stack are always in it, so
+// those accesses skip the bus, which is left to the modes that can reach io.
+static _Thread_local u8 *ram;
+
+static inline void push(u8 data)
 {
-    is_init = true;
+    ram[SP] = data;
+    state.sp--;
+}
+
+static inline u8 pull()
+{
+    state.sp++;
+    return ram[SP];
+}
+
+// write back to where an addressing mode pointed
+static inline void store(u8 data, u16 addr)
+{
+    if (addr < 0x100) {
+        ram[addr] = data;
+    } else {
+        Mem_CpuWrite(data, addr);
+    }
+}
 
-    // setup opcode matrix
+static void init_opmatrix()
+{
     // MSD 0
     opmatrix[0x0*16+0x0] = brk;
     opmatrix[0x0*16+0x1] = ora;
@@ -340,7 +377,14 @@ void Cpu_Init()
     opmatrix[0xF*16+0xD] = sbc;
     opmatrix[0xF*16+0xE] = inc;
     opmatrix[0xF*16+0xF] = isc; // unofficial
+}
 
+static _Thread_local bool is_init = false;
+void Cpu_Init()
+{
+    is_init = true;
+    ram = Mem_Iram();
+    pthread_once(&opmatrix_once, init_opmatrix);
 }
 
 int Cpu_Step()
@@ -348,59 +392,88 @@ int Cpu_Step()
 #ifdef DEBUG
     CHECK_INIT
 #endif
-    prev_state = state;
-    LOG("%04X ", state.pc);
-    // fetch instruction
-    // low 4 bits = LSD
-    // high 4 bits = MSD
-    u8 opcode = Mem_CpuRead(state.pc++);
-    state.op = opcode;
-    LOG(" %02X", state.op);
-    int op_index = ((opcode >> 4) & 0xF) * 16 + (opcode & 0xF); 
-    // execute instruction
-    int clocks = opmatrix[op_index]();
-    assert(clocks != 0);
+    int clocks;
+    // irq line is level triggered, so it is only checked between instructions
+    if (irq_line && !(state.psr & PSR_I)) {
+        clocks = irq();
+    } else {
+        prev_state = state;
+        LOG("%04X ", state.pc);
+        // fetch instruction
+        // low 4 bits = LSD
+        // high 4 bits = MSD
+        u8 opcode = Mem_CpuRead(state.pc++);
+        state.op = opcode;
+        LOG(" %02X", state.op);
+        int op_index = ((opcode >> 4) & 0xF) * 16 + (opcode & 0xF); 
+        // execute instruction
+        clocks = opmatrix[op_index]();
+        assert(clocks != 0);
+        LOG("A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%u (+%d)\n", prev_state.acc,
+            prev_state.x, prev_state.y, prev_state.psr, prev_state.sp, prev_state.cycle,
+            clocks);
+    }
     state.cycle += clocks;
-    LOG("A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%u (+%d)\n", prev_state.acc,
-        prev_state.x, prev_state.y, prev_state.psr, prev_state.sp, prev_state.cycle,
-        clocks);
+    // oam dma halts the cpu once the write is done: 513 cycles, one more
+    // when it has to wait for an even cycle to line up on
+    if (oam_dma) {
+        oam_dma = false;
+        stall_cycles += 513 + (state.cycle & 1);
+    }
+
+    // run any events which came due during this instruction. They may steal
+    // cycles from the cpu (dma), which can make more events come due.
+    Sched_Advance(clocks);
+    while (stall_cycles > 0) {
+        int stall = stall_cycles;
+        stall_cycles = 0;
+        state.cycle += stall;
+        clocks += stall;
+        Sched_Advance(stall);
+    }
     return clocks;
 }
 
 // *** INTERRUPT GENERATORS ***
-void Cpu_Irq()
+static int irq()
 {
-#ifdef DEBUG
-    CHECK_INIT
-#endif
-    // check if interrupts disabled
-    if (state.psr & PSR_I) {
-        return;
-    }
-
     // push pc
     u16 pc_lo = state.pc & 0x00FF;
     u16 pc_hi = (state.pc & 0xFF00) >> 8;
-    Mem_CpuWrite(pc_hi, SP);
-    state.sp--;
-    Mem_CpuWrite(pc_lo, SP);
-    state.sp--;
+    push(pc_hi);
+    push(pc_lo);
     
+    // push psr with B1 flag
+    push(state.psr | PSR_B1);
     // side effect
     state.psr |= PSR_I;
-    // push psr with B1 flag
-    Mem_CpuWrite(state.psr | PSR_B1, SP);
-    state.sp--;
 
-    // call NMI vector
+    // call IRQ vector
     u16 lo = Mem_CpuRead(IRQ_VECTOR);
     u16 hi = Mem_CpuRead(IRQ_VECTOR + 1);
     state.pc = (hi << 8) | lo;
+    return 7;
+}
 
-    // pop back state
-    // state.pc = (pc_hi << 8) | pc_lo;
-    // state.sp += 3;
-    // state.psr = Mem_CpuRead(SP) & ~PSR_B1;
+void Cpu_SetIrq(u8 source)
+{
+    irq_line |= source;
+}
+
+void Cpu_ClearIrq(u8 source)
+{
+    irq_line &= ~source;
+}
+
+void Cpu_Stall(int cycles)
+{
+    stall_cycles += cycles;
+}
+
+// stall for an oam dma started by the current instruction
+void Cpu_OamDma()
+{
+    oam_dma = true;
 }
 
 void Cpu_Nmi()
@@ -411,16 +484,13 @@ void Cpu_Nmi()
     // push pc
     u16 pc_lo = state.pc & 0x00FF;
     u16 pc_hi = (state.pc & 0xFF00) >> 8;
-    Mem_CpuWrite(pc_hi, SP);
-    state.sp--;
-    Mem_CpuWrite(pc_lo, SP);
-    state.sp--;
+    push(pc_hi);
+    push(pc_lo);
 
+    // push psr with B1 flag
+    push(state.psr | PSR_B1);
     // side effect
     state.psr |= PSR_I;
-    // push psr with B1 flag
-    Mem_CpuWrite(state.psr | PSR_B1, SP);
-    state.sp--;
 
     // call NMI vector
     u16 lo = Mem_CpuRead(NMI_VECTOR);
@@ -452,6 +522,27 @@ void Cpu_Reset()
     state.acc = 0;
     state.cycle = 0;
     // state.cycle = 7; // NOTE: FOR TESTING
+    irq_line = 0;
+    stall_cycles = 0;
+    oam_dma = false;
+}
+
+// *** SAVE STATES ***
+size_t Cpu_StateSize()
+{
+    return 0 CPU_STATE(STATE_SIZE);
+}
+
+u8 *Cpu_SaveState(u8 *p)
+{
+    CPU_STATE(STATE_SAVE)
+    return p;
+}
+
+const u8 *Cpu_LoadState(const u8 *p)
+{
+    CPU_STATE(STATE_LOAD)
+    return p;
 }
 
 // *** PSR HELPERS ***
@@ -509,7 +600,7 @@ static void mode_zp(u8 *fetch, u16 *from)
 
     LOG(" %4s $%02X", op_to_str(state.op), zaddr);
     if (fetch != NULL) {
-        *fetch = Mem_CpuRead(zaddr);
+        *fetch = ram[zaddr];
         LOG(" = %02X                       ", *fetch);
     } else {
         LOG("                            ");
@@ -528,7 +619,7 @@ static void mode_zpx(u8 *fetch, u16 *from)
     u16 addr = (zaddr + state.x) & 0xFF;
     LOG(" %4s $%02X,X @ %02X", op_to_str(state.op), zaddr, addr);
     if (fetch != NULL) {
-        *fetch = Mem_CpuRead(addr);
+        *fetch = ram[addr];
         LOG(" = %02X                ", *fetch);
     } else {
         LOG("                     ");
@@ -547,7 +638,7 @@ static void mode_zpy(u8 *fetch, u16 *from)
     u16 addr = (zaddr + state.y) & 0xFF;
     LOG(" %4s $%02X,Y @ %02X", op_to_str(state.op), zaddr, addr);
     if (fetch != NULL) {
-        *fetch = Mem_CpuRead(addr);
+        *fetch = ram[addr];
         LOG(" = %02X                ", *fetch);
     } else {
         LOG("                     ");
@@ -632,8 +723,8 @@ static void mode_indx(u8 *fetch, u16 *from)
     u16 ind_addr = (a + state.x) & 0xFF;
     LOG(" %02X   ", a);
 
-    u16 lo = Mem_CpuRead(ind_addr);
-    u16 hi = Mem_CpuRead((ind_addr + 1) & 0xFF);
+    u16 lo = ram[ind_addr];
+    u16 hi = ram[(ind_addr + 1) & 0xFF];
     u16 addr = (hi << 8) | lo;
 
     LOG(" %4s ($%02X,X) @ %02X = %04X", op_to_str(state.op), a, ind_addr, addr);
@@ -654,8 +745,8 @@ static int mode_indy(u8 *fetch, u16 *from)
     u16 ind_addr = Mem_CpuRead(state.pc++);
     LOG(" %02X   ", ind_addr);
 
-    u16 lo = Mem_CpuRead(ind_addr);
-    u16 hi = Mem_CpuRead((ind_addr + 1) & 0xFF);
+    u16 lo = ram[ind_addr];
+    u16 hi = ram[(ind_addr + 1) & 0xFF];
 
     u16 addr = (hi << 8) | lo;
     u16 yaddr = addr + state.y;
@@ -869,7 +960,7 @@ static int asl()
     // shift left
     u16 res = val << 1;
     if (inmem) {
-        Mem_CpuWrite(res & 0xFF, from);
+        store(res & 0xFF, from);
     } else {
         state.acc = res & 0xFF;
     }
@@ -1044,14 +1135,11 @@ static int brk()
     // push pc
     u8 hi = state.pc >> 8;
     u8 lo = state.pc & 0xFF;
-    Mem_CpuWrite(hi, SP);
-    state.sp--;
-    Mem_CpuWrite(lo, SP);
-    state.sp--;
+    push(hi);
+    push(lo);
     // push psr
     u8 psr_push = state.psr | PSR_B0 | PSR_B1;
-    Mem_CpuWrite(psr_push, SP);
-    state.sp--;
+    push(psr_push);
 
     // set I flag (not sure if needs to be done before stack push)
     set_flag(PSR_I, true);
@@ -1331,7 +1419,7 @@ static int dec()
 
     // decrement and store
     u8 res = val - 1;
-    Mem_CpuWrite(res, from);
+    store(res, from);
 
     // set flags
     set_flag(PSR_Z, res == 0);
@@ -1468,7 +1556,7 @@ static int inc()
 
     // decrement and store
     u8 res = val + 1;
-    Mem_CpuWrite(res, from);
+    store(res, from);
 
     // set flags
     set_flag(PSR_Z, res == 0);
@@ -1554,10 +1642,8 @@ static int jsr()
     mode_abs(NULL, &target);
     // push (pc - 1) to stack
     state.pc--;
-    Mem_CpuWrite(state.pc >> 8, SP);
-    state.sp--;
-    Mem_CpuWrite(state.pc & 0xFF, SP);
-    state.sp--;
+    push(state.pc >> 8);
+    push(state.pc & 0xFF);
     // set subroutine as cur pc
     state.pc = target;
     return 6;
@@ -1759,7 +1845,7 @@ static int lsr()
     // shift left
     u8 res = val >> 1;
     if (inmem) {
-        Mem_CpuWrite(res, from);
+        store(res, from);
     } else {
         state.acc = res;
     }
@@ -1916,8 +2002,7 @@ static int pha()
 {
     assert(state.op == 0x48);
     mode_imp();
-    Mem_CpuWrite(state.acc, SP);
-    state.sp--;
+    push(state.acc);
     return 3;
 }
 
@@ -1932,8 +2017,7 @@ static int php()
     assert(state.op == 0x08);
     mode_imp();
     u8 stack_psr = state.psr | PSR_B0 | PSR_B1;
-    Mem_CpuWrite(stack_psr, SP);
-    state.sp--;
+    push(stack_psr);
     return 3;
 }
 
@@ -1947,8 +2031,7 @@ static int pla()
 {
     assert(state.op == 0x68);
     mode_imp();
-    state.sp++;
-    state.acc = Mem_CpuRead(SP);
+    state.acc = pull();
     // set flags
     set_flag(PSR_Z, state.acc == 0);
     set_flag(PSR_N, state.acc & 0x80);
@@ -1965,8 +2048,7 @@ static int plp()
 {
     assert(state.op == 0x28);
     mode_imp();
-    state.sp++;
-    state.psr = Mem_CpuRead(SP);
+    state.psr = pull();
     // reset fake B flags
     set_flag(PSR_B0, false);
     set_flag(PSR_B1, true);
@@ -2015,7 +2097,7 @@ static int rol()
     // rotate
     u16 res = (val << 1) | (state.psr & PSR_C);
     if (inmem) {
-        Mem_CpuWrite(res & 0xFF, from);
+        store(res & 0xFF, from);
     } else {
         state.acc = res & 0xFF;
     }
@@ -2070,7 +2152,7 @@ static int ror()
     // rotate
     u8 res = (val >> 1) | ((state.psr & PSR_C) << 7);
     if (inmem) {
-        Mem_CpuWrite(res, from);
+        store(res, from);
     } else {
         state.acc = res;
     }
@@ -2094,15 +2176,12 @@ static int rti()
     assert(state.op == 0x40);
     mode_imp();
     // pull psr and remove fake B flags
-    state.sp++;
-    state.psr = Mem_CpuRead(SP);
+    state.psr = pull();
     set_flag(PSR_B0, false);
     set_flag(PSR_B1, true);
     // pull pc
-    state.sp++;
-    u16 lo = Mem_CpuRead(SP);
-    state.sp++;
-    u16 hi = Mem_CpuRead(SP);
+    u16 lo = pull();
+    u16 hi = pull();
     state.pc = (hi << 8) | lo;
     return 6;
 }
@@ -2118,10 +2197,8 @@ static int rts()
     assert(state.op == 0x60);
     mode_imp();
     // pull (pc-1)
-    state.sp++;
-    u16 lo = Mem_CpuRead(SP);
-    state.sp++;
-    u16 hi = Mem_CpuRead(SP);
+    u16 lo = pull();
+    u16 hi = pull();
     state.pc = (hi << 8) | lo;
     state.pc++;
     return 6;
@@ -2279,7 +2356,7 @@ static int sta()
     }
 
     // store acc
-    Mem_CpuWrite(state.acc, from);
+    store(state.acc, from);
     return clocks;
 }
 
@@ -2311,7 +2388,7 @@ static int stx()
         EXIT(1);
     }
     // store x
-    Mem_CpuWrite(state.x, from);
+    store(state.x, from);
     return clocks;
 }
 
@@ -2343,7 +2420,7 @@ static int sty()
         EXIT(1);
     }
     // store x
-    Mem_CpuWrite(state.y, from);
+    store(state.y, from);
     return clocks;
 }
 
@@ -2539,7 +2616,7 @@ static int sax()
 
     // AND X and A then store
     u8 res = state.x & state.acc;
-    Mem_CpuWrite(res, target);
+    store(res, target);
     return clocks;
 }
 
@@ -2593,7 +2670,7 @@ static int dcp()
     // DEC then CMP
     u8 dec_res = val - 1;
     u8 cmp_res = state.acc - dec_res;
-    Mem_CpuWrite(dec_res, from);
+    store(dec_res, from);
 
     // set flags
     set_flag(PSR_C, state.acc >= dec_res);
@@ -2650,7 +2727,7 @@ static int isc()
 
     // INC then SBC
     u8 inc_res = val + 1;
-    Mem_CpuWrite(inc_res, from);
+    store(inc_res, from);
     u8 neg_inc_res = ~inc_res;
     u16 sbc_res = state.acc + neg_inc_res + (state.psr & PSR_C);
     state.acc = sbc_res & 0xFF;
@@ -2711,7 +2788,7 @@ static int rla()
 
     // ROL then AND
     u8 rol_res = val << 1 | (state.psr & PSR_C);
-    Mem_CpuWrite(rol_res, from);
+    store(rol_res, from);
     state.acc &= rol_res;
 
     // set flags
@@ -2769,7 +2846,7 @@ static int rra()
 
     // ROR then ADC
     u8 ror_res = (val >> 1) | ((state.psr & PSR_C) << 7);
-    Mem_CpuWrite(ror_res, from);
+    store(ror_res, from);
     set_flag(PSR_C, val & 0x1);
     u16 adc_res = state.acc + ror_res + (state.psr & PSR_C);
     state.acc = adc_res & 0xFF;
@@ -2830,7 +2907,7 @@ static int slo()
 
     // ASL then ORA
     u8 asl_res = val << 1;
-    Mem_CpuWrite(asl_res, from);
+    store(asl_res, from);
     state.acc |= asl_res;
 
     // set flags
@@ -2888,7 +2965,7 @@ static int sre()
 
     // LSR then EOR
     u8 lsr_res = val >> 1;
-    Mem_CpuWrite(lsr_res, from);
+    store(lsr_res, from);
     state.acc ^= lsr_res;
 
     // set flags
@@ -0,0 +1,103 @@
+/*
+ * framehash.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Frame hash stream for regression runs. Every finished frame's hash can be
+ * written out (one "<frame> <hash>" line per frame) and/or checked against a
+ * golden stream written the same way. Paired with a movie this catches any
+ * change in emulation output.
+ */
+
+#include <inttypes.h>
+
+#include <framehash.h>
+
+static FILE *ofile = NULL;
+static FILE *golden = NULL;
+static bool active = false;
+static u32 frame;
+static u32 mismatches;
+static u32 first_mismatch;
+
+void FrameHash_Open(const char *out_path, const char *golden_path)
+{
+    if (out_path != NULL) {
+        ofile = fopen(out_path, "w");
+        if (ofile == NULL) {
+            perror("fopen");
+            ERROR("Failed to open %s\n", out_path);
+            EXIT(1);
+        }
+    }
+    if (golden_path != NULL) {
+        golden = fopen(golden_path, "r");
+        if (golden == NULL) {
+            perror("fopen");
+            ERROR("Failed to open %s\n", golden_path);
+            EXIT(1);
+        }
+    }
+    frame = 0;
+    mismatches = 0;
+    active = ofile != NULL || golden != NULL;
+}
+
+bool FrameHash_Active()
+{
+    return active;
+}
+
+void FrameHash_Push(u64 hash)
+{
+    if (!active) {
+        return;
+    }
+
+    if (ofile != NULL) {
+        fprintf(ofile, "%u %016" PRIx64 "\n", frame, hash);
+    }
+
+    if (golden != NULL) {
+        unsigned int gframe;
+        uint64_t ghash;
+        if (fscanf(golden, "%u %" SCNx64, &gframe, &ghash) != 2) {
+            INFO("Golden hash stream ended at frame %u\n", frame);
+            fclose(golden);
+            golden = NULL;
+        } else if (gframe != frame || ghash != hash) {
+            if (mismatches == 0) {
+                first_mismatch = frame;
+                WARNING("Frame %u hash %016" PRIx64 " doesn't match golden %016" PRIx64 "\n",
+                    frame, hash, ghash);
+            }
+            mismatches++;
+        }
+    }
+    frame++;
+}
+
+// returns the number of frames which didn't match the golden stream
+u32 FrameHash_Close()
+{
+    if (!active) {
+        return 0;
+    }
+    if (ofile != NULL) {
+        fclose(ofile);
+        ofile = NULL;
+    }
+    if (golden != NULL) {
+        fclose(golden);
+        golden = NULL;
+    }
+    if (mismatches > 0) {
+        WARNING("%u of %u frames differ from golden (first at frame %u)\n",
+            mismatches, frame, first_mismatch);
+    } else {
+        INFO("%u frames hashed\n", frame);
+    }
+    active = false;
+    return mismatches;
+}
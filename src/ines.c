@@ -0,0 +1,125 @@
+/*
+ * ines.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * iNES and NES 2.0 header parser. NES 2.0 headers give exact rom and ram
+ * sizes (12 bit bank counts or exponent sizes, ram as shift counts) plus a
+ * submapper, the cart allocates what they say. iNES headers only know
+ * prg-ram in 8 KB units and imply 8 KB of chr-ram when there's no chr-rom.
+ */
+
+#include <string.h>
+
+#include <ines.h>
+
+// 64 << n bytes, none for 0
+static u32 ram_size(u8 shift)
+{
+    return shift == 0 ? 0 : 64u << shift;
+}
+
+// a 12 bit count of units, or with the top nibble all set an exponent and
+// multiplier: 2^E * (MM*2+1) bytes. false if it's too large to hold.
+static bool rom_size(u8 lsb, u8 msb, size_t unit, size_t *size)
+{
+    if (msb == 0xF) {
+        u8 exp = lsb >> 2;
+        if (exp > 32) {
+            ERROR("Rom size 2^%u is too large\n", exp);
+            return false;
+        }
+        *size = ((size_t) 1 << exp) * ((lsb & 0x3) * 2 + 1);
+        return true;
+    }
+    *size = (((size_t) msb << 8) | lsb) * unit;
+    return true;
+}
+
+// false if filebuf isn't an iNES or NES 2.0 image
+bool Ines_ReadHeader(const u8 *filebuf, size_t len, ines_header_t *header)
+{
+    assert(filebuf != NULL && header != NULL);
+
+    memset(header, 0, sizeof(*header));
+
+    // check magic number
+    if (len < INES_HEADER_SIZE || memcmp(filebuf, "NES\x1A", 4) != 0) {
+        ERROR("Not an iNES file (bad magic number)\n");
+        return false;
+    }
+
+    u8 flags6 = filebuf[6];
+    u8 flags7 = filebuf[7];
+    header->nes2 = (flags7 & 0x0C) == 0x08;
+
+    // fill in flags
+    u8 mirror_v         = (flags6 >> 0) & 0x1;
+    header->battery     = (flags6 >> 1) & 0x1;
+    header->trainer     = (flags6 >> 2) & 0x1;
+    u8 fourscreen_mir   = (flags6 >> 3) & 0x1;
+    header->mapper_num  = (flags6 >> 4) & 0xF;
+    header->mapper_num |= (flags7 & 0xF0);
+
+    if (header->nes2) {
+        header->mapper_num |= (filebuf[8] & 0x0F) << 8;
+        header->submapper = filebuf[8] >> 4;
+        if (!rom_size(filebuf[4], filebuf[9] & 0x0F, PRGROM_BANK_SIZE, &header->prgrom_size)
+                || !rom_size(filebuf[5], filebuf[9] >> 4, CHRROM_BANK_SIZE, &header->chrrom_size)) {
+            return false;
+        }
+        header->prgram_size = ram_size(filebuf[10] & 0x0F);
+        header->prgnvram_size = ram_size(filebuf[10] >> 4);
+        header->chrram_size = ram_size(filebuf[11] & 0x0F);
+        header->chrnvram_size = ram_size(filebuf[11] >> 4);
+    } else {
+        // old dumps have junk ("DiskDude!") in bytes 7-15, the top nibble
+        // of the mapper number and the prg-ram size along with it
+        bool junk = filebuf[12] | filebuf[13] | filebuf[14] | filebuf[15];
+        u8 prgram_units = junk ? 0 : filebuf[8];
+        if (junk) {
+            header->mapper_num &= 0x0F;
+        }
+        header->prgrom_size = filebuf[4] * PRGROM_BANK_SIZE;
+        header->chrrom_size = filebuf[5] * CHRROM_BANK_SIZE;
+        // 0 KB of prg-ram means 8 KB for compatibility, there's always some
+        u32 prgram = (prgram_units ? prgram_units : 1) * 8 * 1024;
+        if (header->battery) {
+            header->prgnvram_size = prgram;
+        } else {
+            header->prgram_size = prgram;
+        }
+        header->chrram_size = header->chrrom_size == 0 ? 8 * 1024 : 0;
+    }
+
+    // set mirror mode
+    // first check if four screen mode on
+    if (fourscreen_mir) {
+        header->mirror_mode = MIR_4SCRN;
+    } else if (mirror_v) {
+        header->mirror_mode = MIR_VERT;
+    } else {
+        header->mirror_mode = MIR_HORZ;
+    }
+
+    return true;
+}
+
+// crc32 of the prg and chr data, what the rom database is keyed by. the
+// trainer and anything past the chr data (junk on bad dumps) are left out,
+// unless the file is too short to hold what the header says, then it's
+// everything after the header and trainer.
+u32 Ines_DataCrc(const ines_header_t *header, const u8 *filebuf, size_t len)
+{
+    size_t start = INES_HEADER_SIZE + (header->trainer ? INES_TRAINER_SIZE : 0);
+    if (len < start) {
+        start = len;
+    }
+    size_t data_len = len - start;
+    size_t rom_size = header->prgrom_size + header->chrrom_size;
+    if (rom_size <= data_len) {
+        data_len = rom_size;
+    }
+    return Utils_Crc32(filebuf + start, data_len, 0);
+}
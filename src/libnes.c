@@ -0,0 +1,243 @@
+/*
+ * libnes.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Frame stepping api over the cpu, ppu, apu and cartridge. This is all the
+ * frontends (nes, nes-batch) talk to for running the console.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libnes.h>
+#include <mem.h>
+#include <cart.h>
+#include <cpu.h>
+#include <ppu.h>
+#include <apu.h>
+#include <scheduler.h>
+#include <state.h>
+#include <rom.h>
+#include <romdb.h>
+
+// the cpu runs at least this many cycles before the ppu and apu catch up
+#define STEP_CYCLES 10
+
+// the loaded rom, the cartridge uses its banks in place. files are mapped
+// and shared with other consoles, memory images are a private copy.
+// compressed roms (gzip, zip) are inflated either way.
+static _Thread_local const rom_image_t *rom = NULL;
+static _Thread_local char *save_path = NULL;
+static _Thread_local romdb_t *romdb = NULL;
+
+void Nes_Init()
+{
+    Mem_Init();
+    Sched_Init();
+    Cart_Init();
+    Cpu_Init();
+    Ppu_Init();
+    Apu_Init();
+}
+
+static void release_rom()
+{
+    Rom_Close(rom);
+    rom = NULL;
+}
+
+// swaps in image and powers on with it, a cart that won't load leaves no
+// rom at all (the old one is gone with the cartridge's state)
+static bool power_on(const rom_image_t *image)
+{
+    // NOTE: cartridge must be loaded before any other reset (but after the
+    // scheduler, the mapper may use it)
+    Mem_PowerOn();
+    Sched_Reset();
+    bool loaded = Cart_Load(image->data, image->len);
+    release_rom();
+    if (!loaded) {
+        Rom_Close(image);
+        return false;
+    }
+    rom = image;
+    Cpu_Reset();
+    Ppu_Reset();
+    Apu_Reset();
+    return true;
+}
+
+// copies the rom and powers the console on with it, false if it can't be
+// loaded
+bool Nes_LoadRom(const u8 *data, size_t len)
+{
+    const rom_image_t *image = Rom_FromMemory(data, len);
+    if (image == NULL) {
+        return false;
+    }
+    return power_on(image);
+}
+
+// maps the rom (shared with any other console running it) and powers on,
+// false if it can't be loaded
+bool Nes_LoadRomFile(const char *path)
+{
+    const rom_image_t *image = Rom_Open(path);
+    if (image == NULL || !power_on(image)) {
+        ERROR("Failed to load %s\n", path);
+        return false;
+    }
+    INFO("%s loaded successfully!\n", path);
+    return true;
+}
+
+// the reset button: console and cartridge ram are kept
+void Nes_Reset()
+{
+    if (rom == NULL) {
+        ERROR("Reset Failed: No Roms loaded :/\n");
+        EXIT(1);
+    }
+    Sched_Reset();
+    Cart_Reset();
+    Cpu_Reset();
+    Ppu_Reset();
+    Apu_Reset();
+}
+
+// battery ram of roms loaded from now on lives in this file (NULL for
+// none), it's written as the game writes and flushed on frame boundaries
+void Nes_SetSaveFile(const char *path)
+{
+    free(save_path);
+    save_path = NULL;
+    if (path != NULL) {
+        save_path = strdup(path);
+        if (save_path == NULL) {
+            ERROR("Out of Host Memory!\n");
+            EXIT(1);
+        }
+    }
+    Cart_SetSaveFile(save_path);
+}
+
+// roms loaded from now on are looked up in this database (NULL for none),
+// it's believed over their headers. see nes-romdb for building one. false
+// if it can't be opened, there's no database then.
+bool Nes_SetRomDb(const char *path)
+{
+    Romdb_Close(romdb);
+    romdb = NULL;
+    Cart_SetRomDb(NULL);
+    if (path == NULL) {
+        return true;
+    }
+    romdb = Romdb_Open(path);
+    if (romdb == NULL) {
+        return false;
+    }
+    Cart_SetRomDb(romdb);
+    INFO("%s: %lu roms\n", path, (unsigned long) Romdb_Count(romdb));
+    return true;
+}
+
+// buttons is a mask of nes_button, read by the game on its next strobe
+void Nes_SetInput(int port, u8 buttons)
+{
+    Mem_SetInput(port, buttons);
+}
+
+// run until the ppu finishes a frame, returns the cpu cycles it took
+u32 Nes_StepFrame()
+{
+    Apu_ClearSamples();
+    u32 total = 0;
+    bool frame_finished = false;
+    while (!frame_finished) {
+        u32 cycles = 0;
+        while (cycles < STEP_CYCLES) {
+            cycles += Cpu_Step();
+        }
+        frame_finished = Ppu_Step(3 * cycles);
+        Apu_Step(cycles / 2);
+        total += cycles;
+    }
+    Cart_FlushSave();
+    return total;
+}
+
+// run at least the given number of cpu cycles (whole instructions), returns
+// true if a frame was finished along the way
+bool Nes_StepCycles(u32 cycles)
+{
+    Apu_ClearSamples();
+    u32 total = 0;
+    bool frame_finished = false;
+    while (total < cycles) {
+        u32 chunk = cycles - total < STEP_CYCLES ? cycles - total : STEP_CYCLES;
+        u32 done = 0;
+        while (done < chunk) {
+            done += Cpu_Step();
+        }
+        frame_finished |= Ppu_Step(3 * done);
+        Apu_Step(done / 2);
+        total += done;
+    }
+    if (frame_finished) {
+        Cart_FlushSave();
+    }
+    return frame_finished;
+}
+
+// NES_RES_X * NES_RES_Y pixels of the last (or in progress) frame
+const nes_color_t *Nes_Frame()
+{
+    return Ppu_Frame();
+}
+
+u64 Nes_HashFrame()
+{
+    return Utils_Hash64(Ppu_Frame(), NES_RES_X * NES_RES_Y * sizeof(nes_color_t), 0);
+}
+
+// mono float samples at NES_SAMPLE_RATE from the last step
+const float *Nes_Audio(size_t *count)
+{
+    return Apu_Samples(count);
+}
+
+// frames that won't be looked at can skip composing pixels
+void Nes_SetSkipRender(bool skip)
+{
+    Ppu_SetSkipRender(skip);
+}
+
+void Nes_SetAudioOutput(bool on)
+{
+    Apu_SetOutput(on);
+}
+
+// pattern table tiles ($0000-$1FFF, 16 bytes each) written or banked in
+// since the last call: bit (tile & 63) of word (tile >> 6). for caches of
+// decoded tiles, so they only redo the ones that changed.
+void Nes_ChrDirty(u64 dirty[NES_CHR_DIRTY_WORDS])
+{
+    Cart_ChrDirty(CHR_LIBNES, dirty);
+}
+
+size_t Nes_StateSize()
+{
+    return State_Size();
+}
+
+void Nes_SaveState(u8 *buf)
+{
+    State_Save(buf);
+}
+
+bool Nes_LoadState(const u8 *buf, size_t len)
+{
+    return State_Load(buf, len);
+}
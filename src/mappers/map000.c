@@ -9,67 +9,28 @@
 
 #include <utils.h>
 #include <cart.h>
+#include <mappers.h>
 
-static size_t prgrom_banks;
-static size_t chrrom_banks;
+static _Thread_local u16 prgrom_banks;
 
-void Map000_Init(u8 _prgrom_banks, u8 _chrrom_banks)
+// no registers, prg-rom ignores writes and there's nothing to save
+static void Map000_Init(u16 _prgrom_banks, u16 _chrrom_banks)
 {
+    (void) _chrrom_banks;
     prgrom_banks = _prgrom_banks;
-    chrrom_banks = _chrrom_banks;
 }
 
-bool Map000_CpuRead(u32 *addr)
+static void map_banks()
 {
-    // TODO figure out what this is?
-    if (*addr < 0x6000) {
-        WARNING("Trying to access mystery address ($%04X)\n", *addr);
-        // no maps
-        return true;
-    }
-
-    if (prgrom_banks == 1) {
-        *addr &= ~0x4000;
-    }
-    return true;
-
-}
-
-bool Map000_CpuWrite(u8 data, u32 *addr)
-{
-    (void) data;
-    // PRG-ROM
-    if (*addr >= 0x8000) {
-        // no writes
-        return false;
-    }
-
-    // TODO figure out what this is?
-    if (*addr < 0x6000) {
-        WARNING("Trying to access unsupported address ($%04X)\n", *addr);
-        // no maps
-        return true;
-    }
-
-    // else no maps
-    return true;
+    // 16KB of prg-rom is mirrored into $C000-$FFFF
+    Cart_MapPrg(0x8000, 0x4000, 0);
+    Cart_MapPrg(0xC000, 0x4000, prgrom_banks - 1);
+    Cart_MapChr(0x0000, 0x2000, 0);
 }
 
-bool Map000_PpuRead(u32 *addr)
-{
-    (void) addr;
-    return true;
-}
-
-bool Map000_PpuWrite(u8 data, u32 *addr)
-{
-    (void) data;
-    (void) addr;
-    // only writes if pattern mem is ram
-    return chrrom_banks == 0;
-}
-
-enum mirror_mode Map000_GetMirrorMode()
-{
-    return MIR_DEFAULT;
-}
+const mapper_t Map000 = {
+    .num = 0,
+    .name = "NROM",
+    .init = Map000_Init,
+    .banks = map_banks,
+};
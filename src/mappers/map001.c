@@ -9,6 +9,8 @@
 
 #include <utils.h>
 #include <cart.h>
+#include <state.h>
+#include <mappers.h>
 
 // *** Control Reg Bitfield ***
 // BITS
@@ -24,22 +26,53 @@
 //     bank mode
 
 // Registers
-static u8 loadreg;
-static u8 ctrlreg;
-static u8 chrbank0;
-static u8 chrbank1;
-static u8 prgbank;
-static u8 shifts;
+static _Thread_local u8 loadreg;
+static _Thread_local u8 ctrlreg;
+static _Thread_local u8 chrbank0;
+static _Thread_local u8 chrbank1;
+static _Thread_local u8 prgbank;
+static _Thread_local u8 shifts;
 
 // Number of banks
-static u8 prgrom_banks;
-static u8 chrrom_banks;
+static _Thread_local u16 prgrom_banks;
 
 // current mirror mode
-static enum mirror_mode mirmode;
+static _Thread_local enum mirror_mode mirmode;
 
-void Map001_Init(u8 _prgrom_banks, u8 _chrrom_banks)
+// publish the banks the registers select
+static void map_banks()
 {
+    u8 prgrom_bank_mode = (ctrlreg >> 2) & 0x3;
+    if (prgrom_bank_mode == 0 || prgrom_bank_mode == 1) {
+        // 32 KB switching at 0x8000
+        Cart_MapPrg(0x8000, 0x8000, prgbank >> 1);
+    } else if (prgrom_bank_mode == 2) {
+        // fix first bank at $8000
+        Cart_MapPrg(0x8000, 0x4000, 0);
+        Cart_MapPrg(0xC000, 0x4000, prgbank);
+    } else {
+        // fix last bank at $C000
+        Cart_MapPrg(0x8000, 0x4000, prgbank);
+        Cart_MapPrg(0xC000, 0x4000, prgrom_banks - 1);
+    }
+
+    u8 chrbank_mode = (ctrlreg >> 4) & 0x1;
+    if (chrbank_mode == 1) {
+        // 4KB mode
+        Cart_MapChr(0x0000, 0x1000, chrbank0);
+        Cart_MapChr(0x1000, 0x1000, chrbank1);
+    } else {
+        // 8KB mode
+        Cart_MapChr(0x0000, 0x2000, chrbank0 >> 1);
+    }
+
+    Cart_SetMirrorMode(mirmode);
+}
+
+static void Map001_Init(u16 _prgrom_banks, u16 _chrrom_banks)
+{
+    (void) _chrrom_banks;
+
     // init regs
     loadreg  = 0x00;
     ctrlreg  = 0x1C;
@@ -50,38 +83,14 @@ void Map001_Init(u8 _prgrom_banks, u8 _chrrom_banks)
 
     // init banks
     prgrom_banks = _prgrom_banks;
-    chrrom_banks = _chrrom_banks;
 
     // init mirror mode 
     mirmode = MIR_DEFAULT;
 }
 
-bool Map001_CpuRead(u32 *addr)
-{
-    if (*addr >= 0x8000) {
-        u8 prgrom_bank_mode = (ctrlreg >> 2) & 0x3;
-        if (prgrom_bank_mode == 0 || prgrom_bank_mode == 1) {
-            // 32 KB switching at 0x8000
-            *addr = *addr + ((prgbank >> 1) * 0x8000);
-        } else if (prgrom_bank_mode == 2) {
-            // fix first bank at $8000
-            *addr = *addr < 0xC000
-                ? *addr
-                : ((*addr - 0x4000) + (prgbank * 0x4000));
-        } else {
-            // fix last bank at $C000
-            *addr = *addr >= 0xC000
-                ? (*addr - 0x4000) + ((prgrom_banks - 1) * 0x4000)
-                : (*addr + (prgbank * 0x4000));
-        }
-    }
-
-    return true;
-}
-
-bool Map001_CpuWrite(u8 data, u32 *addr)
+static void Map001_Write(u8 data, u16 addr)
 {
-    if (*addr >= 0x8000) {
+    if (addr >= 0x8000) {
         if (data & 0x80) {
             // reset
             loadreg = 0x00;
@@ -92,7 +101,7 @@ bool Map001_CpuWrite(u8 data, u32 *addr)
             loadreg |= (data & 0x01) << 4;
             if (shifts == 5) {
                 // update the internal register
-                switch ((*addr >> 13) & 0xF) {
+                switch ((addr >> 13) & 0xF) {
                 case 0b100: // CONTROL
                     ctrlreg = loadreg;
                     // set cur mirror mode
@@ -124,57 +133,43 @@ bool Map001_CpuWrite(u8 data, u32 *addr)
                     ERROR("This shouldn't print! Check your bitwise math!\n");
                     EXIT(1);
                 }
+                map_banks();
 
                 // reset
                 loadreg = 0x00;
                 shifts = 0;
             }
         }
-        return false;
-    } else {
-        return true;
     }
 }
 
-static u32 chrmap_helper(u32 addr)
-{
-    u8 chrbank_mode = (ctrlreg >> 4) & 0x1;
-    if (chrbank_mode == 1) {
-        // 4KB mode
-        if (addr < 0x1000) {
-            addr = addr + (chrbank0 * 0x1000);
-        } else {
-            addr = (addr - 0x1000) + (chrbank1 * 0x1000);
-        }
-    } else {
-        // 8KB mode
-        addr = addr + ((chrbank0 >> 1) * 0x2000);
-    }
-    return addr;
-}
+// *** SAVE STATES ***
+#define MAP001_STATE(X) X(loadreg) X(ctrlreg) X(chrbank0) X(chrbank1) X(prgbank) X(shifts) X(mirmode)
 
-bool Map001_PpuRead(u32 *addr)
+static size_t Map001_StateSize()
 {
-    *addr = chrmap_helper(*addr);
-    return true;
+    return 0 MAP001_STATE(STATE_SIZE);
 }
 
-bool Map001_PpuWrite(u8 data, u32 *addr)
+static u8 *Map001_SaveState(u8 *p)
 {
-    (void) data;
-    if (chrrom_banks != 0) {
-        // using ROM -- no write access!
-        return false;
-    }
-
-    *addr = chrmap_helper(*addr);
-    return true;
+    MAP001_STATE(STATE_SAVE)
+    return p;
 }
 
-enum mirror_mode Map001_GetMirrorMode()
+static const u8 *Map001_LoadState(const u8 *p)
 {
-    return mirmode;
+    MAP001_STATE(STATE_LOAD)
+    return p;
 }
 
-
-
+const mapper_t Map001 = {
+    .num = 1,
+    .name = "MMC1",
+    .init = Map001_Init,
+    .banks = map_banks,
+    .write = Map001_Write,
+    .statesize = Map001_StateSize,
+    .savestate = Map001_SaveState,
+    .loadstate = Map001_LoadState,
+};
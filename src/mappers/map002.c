@@ -9,65 +9,65 @@
 
 #include <utils.h>
 #include <cart.h>
+#include <state.h>
+#include <mappers.h>
 
-static u8 prgrom_banks;
-static u8 chrrom_banks;
+static _Thread_local u16 prgrom_banks;
 
 // Register
-static u8 prgrom_bank_select;
+static _Thread_local u8 prgrom_bank_select;
 
-void Map002_Init(u8 _prgrom_banks, u8 _chrrom_banks)
+static void map_banks()
 {
-    chrrom_banks = _chrrom_banks;
-    prgrom_banks = _prgrom_banks;
-    prgrom_bank_select = 0x00;
+    // switchable first 16 KB, last bank fixed at $C000
+    Cart_MapPrg(0x8000, 0x4000, prgrom_bank_select);
+    Cart_MapPrg(0xC000, 0x4000, prgrom_banks - 1);
+    Cart_MapChr(0x0000, 0x2000, 0);
 }
 
-bool Map002_CpuRead(u32 *addr)
+static void Map002_Init(u16 _prgrom_banks, u16 _chrrom_banks)
 {
-    // first 16 KB in PRGROM
-    if (*addr >= 0x8000 && *addr <= 0xBFFF) {
-        *addr = *addr + (prgrom_bank_select * 0x4000);
-        return true;
-    }
-
-    // last 16 KB in PRGROM
-    if (*addr >= 0xC000) {
-        // select the last bank
-        *addr = (*addr - 0x4000) + ((prgrom_banks - 1) * 0x4000);
-        return true;
-    }
-
-    return true;
+    (void) _chrrom_banks;
+    prgrom_banks = _prgrom_banks;
+    prgrom_bank_select = 0x00;
 }
 
-bool Map002_CpuWrite(u8 data, u32 *addr)
+static void Map002_Write(u8 data, u16 addr)
 {
     // PRG-ROM (register access)
-    if (*addr >= 0x8000) {
+    if (addr >= 0x8000) {
         prgrom_bank_select = data & 0x0F;
-        return false;
+        map_banks();
     }
-
-    return true;
 }
 
-bool Map002_PpuRead(u32 *addr)
+// *** SAVE STATES ***
+#define MAP002_STATE(X) X(prgrom_bank_select)
+
+static size_t Map002_StateSize()
 {
-    (void) addr;
-    return true;
+    return 0 MAP002_STATE(STATE_SIZE);
 }
 
-bool Map002_PpuWrite(u8 data, u32 *addr)
+static u8 *Map002_SaveState(u8 *p)
 {
-    assert(*addr < 0x2000);
-    (void) addr;
-    (void) data;
-    return chrrom_banks == 0;
+    MAP002_STATE(STATE_SAVE)
+    return p;
 }
 
-enum mirror_mode Map002_GetMirrorMode()
+static const u8 *Map002_LoadState(const u8 *p)
 {
-    return MIR_DEFAULT;
+    MAP002_STATE(STATE_LOAD)
+    return p;
 }
 
+const mapper_t Map002 = {
+    .num = 2,
+    .name = "UxROM",
+    .init = Map002_Init,
+    .banks = map_banks,
+    .write = Map002_Write,
+    .statesize = Map002_StateSize,
+    .savestate = Map002_SaveState,
+    .loadstate = Map002_LoadState,
+};
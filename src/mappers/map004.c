@@ -0,0 +1,237 @@
+/*
+ * map004.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Mapper 4 Boards: MMC3 (TxROM)
+ *
+ * The scanline counter is clocked by rising edges of ppu a12. Rather than
+ * watch the ppu fetches we ask the ppu where the edges will fall
+ * (Ppu_A12Rise) and schedule an event at the edge that takes the counter to
+ * zero. Between events the counter is only brought up to date when something
+ * it depends on changes: our registers, or the ppu moving its edges.
+ * https://wiki.nesdev.com/w/index.php/MMC3
+ */
+
+#include <utils.h>
+#include <cart.h>
+#include <cpu.h>
+#include <ppu.h>
+#include <scheduler.h>
+#include <state.h>
+#include <mappers.h>
+
+// Registers
+static _Thread_local u8 bank_select; // 0-2: R0-R7 for the next bank data write
+                                     // 6: PRG-ROM bank mode, 7: CHR A12 inversion
+static _Thread_local u8 banks[8];    // R0-R7
+static _Thread_local u8 prgram_protect;
+
+// IRQ counter
+static _Thread_local u8 irq_latch;
+static _Thread_local u8 irq_counter;
+static _Thread_local bool irq_reload;
+static _Thread_local bool irq_enabled;
+static _Thread_local u64 irq_synced; // cpu cycle the counter is up to date with
+
+// Number of banks
+static _Thread_local u16 prgrom_banks;
+
+// current mirror mode
+static _Thread_local enum mirror_mode mirmode;
+
+// publish the banks the registers select
+static void map_banks()
+{
+    u32 last = prgrom_banks * 2 - 1; // in 8 KB banks
+    u8 prg_mode = (bank_select >> 6) & 0x1;
+    u8 chr_inversion = (bank_select >> 7) & 0x1;
+
+    // mode 0: R6 at $8000, second last at $C000. mode 1: swapped
+    Cart_MapPrg(0x8000, 0x2000, prg_mode ? last - 1 : (banks[6] & 0x3F));
+    Cart_MapPrg(0xA000, 0x2000, banks[7] & 0x3F);
+    Cart_MapPrg(0xC000, 0x2000, prg_mode ? (banks[6] & 0x3F) : last - 1);
+    Cart_MapPrg(0xE000, 0x2000, last);
+
+    // two 2 KB banks and four 1 KB banks, inversion swaps the halves
+    u16 twos = chr_inversion ? 0x1000 : 0x0000;
+    u16 ones = chr_inversion ? 0x0000 : 0x1000;
+    Cart_MapChr(twos + 0x0000, 0x800, banks[0] >> 1);
+    Cart_MapChr(twos + 0x0800, 0x800, banks[1] >> 1);
+    Cart_MapChr(ones + 0x0000, 0x400, banks[2]);
+    Cart_MapChr(ones + 0x0400, 0x400, banks[3]);
+    Cart_MapChr(ones + 0x0800, 0x400, banks[4]);
+    Cart_MapChr(ones + 0x0C00, 0x400, banks[5]);
+
+    Cart_SetMirrorMode(mirmode);
+}
+
+// one a12 edge
+static void clock_counter()
+{
+    if (irq_counter == 0 || irq_reload) {
+        irq_counter = irq_latch;
+        irq_reload = false;
+    } else {
+        irq_counter--;
+    }
+    if (irq_counter == 0 && irq_enabled) {
+        Cpu_SetIrq(IRQ_MAPPER);
+    }
+}
+
+// apply the edges since the last sync
+static void sync_counter(u64 now)
+{
+    u32 edges = Ppu_A12Rises(irq_synced, now);
+    irq_synced = now;
+    while (edges-- > 0) {
+        clock_counter();
+    }
+}
+
+// schedule the edge which takes the counter to zero. it's scheduled even
+// with irqs off so the counter never gets far behind.
+static void predict_counter(u64 now)
+{
+    u32 edges = (irq_counter == 0 || irq_reload) ? irq_latch + 1 : irq_counter;
+    u64 at = Ppu_A12Rise(now, edges);
+    if (at == SCHED_NEVER) {
+        Sched_Cancel(EV_MAPPER_IRQ);
+    } else {
+        Sched_Add(EV_MAPPER_IRQ, at);
+    }
+}
+
+static void irq_event(u64 when)
+{
+    sync_counter(when);
+    predict_counter(when);
+}
+
+static void Map004_Init(u16 _prgrom_banks, u16 _chrrom_banks)
+{
+    (void) _chrrom_banks;
+
+    // init regs
+    bank_select = 0x00;
+    banks[0] = 0;
+    banks[1] = 2;
+    banks[2] = 4;
+    banks[3] = 5;
+    banks[4] = 6;
+    banks[5] = 7;
+    banks[6] = 0;
+    banks[7] = 1;
+    prgram_protect = 0x00;
+
+    irq_latch = 0;
+    irq_counter = 0;
+    irq_reload = false;
+    irq_enabled = false;
+    irq_synced = Sched_Now();
+    Sched_Register(EV_MAPPER_IRQ, irq_event);
+    Sched_Cancel(EV_MAPPER_IRQ);
+
+    // init banks
+    prgrom_banks = _prgrom_banks;
+
+    // init mirror mode
+    mirmode = MIR_DEFAULT;
+}
+
+static void Map004_Write(u8 data, u16 addr)
+{
+    if (addr < 0x8000) {
+        return;
+    }
+
+    // registers are decoded by the top 3 bits and bit 0 (even/odd)
+    switch (addr & 0xE001) {
+    case 0x8000: // BANK SELECT
+        bank_select = data;
+        map_banks();
+        break;
+    case 0x8001: // BANK DATA
+        banks[bank_select & 0x7] = data;
+        map_banks();
+        break;
+    case 0xA000: // MIRRORING
+        mirmode = (data & 0x1) ? MIR_HORZ : MIR_VERT;
+        Cart_SetMirrorMode(mirmode);
+        break;
+    case 0xA001: // PRG-RAM PROTECT
+        // kept for save states, prg-ram is always enabled (mmc6 boards
+        // share the number and use these bits differently)
+        prgram_protect = data;
+        break;
+    default:
+        // irq registers, catch the counter up to now before changing it
+        sync_counter(Sched_Now());
+        switch (addr & 0xE001) {
+        case 0xC000: // IRQ LATCH
+            irq_latch = data;
+            break;
+        case 0xC001: // IRQ RELOAD
+            irq_counter = 0;
+            irq_reload = true;
+            break;
+        case 0xE000: // IRQ DISABLE (and acknowledge)
+            irq_enabled = false;
+            Cpu_ClearIrq(IRQ_MAPPER);
+            break;
+        case 0xE001: // IRQ ENABLE
+            irq_enabled = true;
+            break;
+        }
+        predict_counter(Sched_Now());
+        break;
+    }
+}
+
+static void Map004_A12Changing()
+{
+    sync_counter(Sched_Now());
+}
+
+static void Map004_A12Changed()
+{
+    predict_counter(Sched_Now());
+}
+
+// *** SAVE STATES ***
+// the pending counter event is part of the scheduler's state
+#define MAP004_STATE(X) X(bank_select) X(banks) X(mirmode) X(prgram_protect) \
+    X(irq_latch) X(irq_counter) X(irq_reload) X(irq_enabled) X(irq_synced)
+
+static size_t Map004_StateSize()
+{
+    return 0 MAP004_STATE(STATE_SIZE);
+}
+
+static u8 *Map004_SaveState(u8 *p)
+{
+    MAP004_STATE(STATE_SAVE)
+    return p;
+}
+
+static const u8 *Map004_LoadState(const u8 *p)
+{
+    MAP004_STATE(STATE_LOAD)
+    return p;
+}
+
+const mapper_t Map004 = {
+    .num = 4,
+    .name = "MMC3",
+    .flags = MAPPER_IRQ | MAPPER_A12,
+    .init = Map004_Init,
+    .banks = map_banks,
+    .write = Map004_Write,
+    .statesize = Map004_StateSize,
+    .savestate = Map004_SaveState,
+    .loadstate = Map004_LoadState,
+    .a12changing = Map004_A12Changing,
+    .a12changed = Map004_A12Changed,
+};
@@ -0,0 +1,26 @@
+/*
+ * mappers.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Registry of the supported mappers, indexed by mapper number.
+ */
+
+#include <mappers.h>
+
+static const mapper_t *const registry[MAPPER_MAX] = {
+    [0] = &Map000,
+    [1] = &Map001,
+    [2] = &Map002,
+    [4] = &Map004,
+};
+
+// NULL if the mapper isn't supported
+const mapper_t *Mappers_Get(u16 num)
+{
+    if (num >= MAPPER_MAX) {
+        return NULL;
+    }
+    return registry[num];
+}
@@ -9,16 +9,18 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <utils.h>
 #include <cart.h>
 #include <ppu.h>
-#include <vac.h>
 #include <apu.h>
+#include <state.h>
+#include <movie.h>
 
 #define CHECK_INIT if(!is_init){ERROR("Not Initialized!\n"); EXIT(1);}
 
-static bool is_init = false;
+static _Thread_local bool is_init = false;
 void Mem_Init()
 {
     is_init = true;
@@ -49,8 +51,10 @@ void Mem_Init()
 // |     (49.120 KB)     |
 // -----------------------
 // **********************************************************************
-static u8 iram[2*1024] = {0};
-static u8 controller[2] = {0};
+static _Thread_local u8 iram[2*1024] = {0};
+static _Thread_local u8 controller[2] = {0};
+// buttons held on each pad, set by the frontend (not machine state)
+static _Thread_local u8 input[2] = {0};
 
 u8 Mem_CpuRead(u16 addr)
 {
@@ -111,6 +115,29 @@ u8 Mem_CpuRead(u16 addr)
     return 0;
 }
 
+// the 2 KB of internal ram, for the cpu's zero page and stack accesses
+u8 *Mem_Iram()
+{
+    return iram;
+}
+
+// host memory behind a cpu page, for bulk reads that see exactly what
+// Mem_CpuRead would (oam dma). NULL for pages with registers in them.
+const u8 *Mem_CpuPage(u8 hi)
+{
+#ifdef DEBUG
+    CHECK_INIT;
+#endif
+    if (hi < 0x20) {
+        return iram + ((hi << 8) & 0x7FF);
+    }
+    // $4000-$40FF has the apu and io registers
+    if (hi > 0x40) {
+        return Cart_CpuPage(hi);
+    }
+    return NULL;
+}
+
 void Mem_CpuWrite(u8 data, u16 addr)
 {
 #ifdef DEBUG
@@ -142,18 +169,15 @@ void Mem_CpuWrite(u8 data, u16 addr)
         case 0x4014:
             Ppu_Oamdma(data);
             break;
-        case 0x4016: // Controller 1
+        case 0x4016: // Controller strobe, latches both pads
             if (data & 0x1) {
-                controller[0] = Vac_Poll() & 0xFF;
-            }
-            break;
-        case 0x4017: // Controller 2
-            if (data & 0x1) {
-                controller[1] = Vac_Poll() & 0xFF;
+                controller[0] = Movie_Latch(0);
+                controller[1] = Movie_Latch(1);
             }
             break;
         default:
-            // let the apu handle the rest of the addresses
+            // let the apu handle the rest of the addresses ($4017 is its
+            // frame counter, controller 2 is only read there)
             Apu_Write(data, addr);
             break;
         }
@@ -194,8 +218,34 @@ void Mem_CpuWrite(u8 data, u16 addr)
 // |       (256 B)       |
 // -----------------------
 // **********************************************************************
-static u8 vram[(4*1024)] = {0};
-static u8 palmem[256] = {0};
+static _Thread_local u8 vram[(4*1024)] = {0};
+static _Thread_local u8 palmem[256] = {0};
+
+#define MEM_STATE(X) X(iram) X(controller) X(vram) X(palmem)
+
+// clear all console ram, as if the power was cycled (a reset keeps it)
+void Mem_PowerOn()
+{
+#ifdef DEBUG
+    CHECK_INIT;
+#endif
+    memset(iram, 0, sizeof(iram));
+    memset(controller, 0, sizeof(controller));
+    memset(vram, 0, sizeof(vram));
+    memset(palmem, 0, sizeof(palmem));
+}
+
+void Mem_SetInput(int port, u8 buttons)
+{
+    assert(port == 0 || port == 1);
+    input[port] = buttons;
+}
+
+u8 Mem_GetInput(int port)
+{
+    assert(port == 0 || port == 1);
+    return input[port];
+}
 
 
 static u16 mirror(u16 addr)
@@ -343,6 +393,24 @@ void Mem_PpuWrite(u8 data, u16 addr)
     WARNING("Attempt to write past ppu address $3FFF ($%02X -> $%04X)\n", data, addr);
 }
 
+// *** SAVE STATES ***
+size_t Mem_StateSize()
+{
+    return 0 MEM_STATE(STATE_SIZE);
+}
+
+u8 *Mem_SaveState(u8 *p)
+{
+    MEM_STATE(STATE_SAVE)
+    return p;
+}
+
+const u8 *Mem_LoadState(const u8 *p)
+{
+    MEM_STATE(STATE_LOAD)
+    return p;
+}
+
 // *** DEBUG TOOLS ***
 void Mem_Dump()
 {
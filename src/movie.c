@@ -0,0 +1,262 @@
+/*
+ * movie.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Input movies. A movie is the controller byte latched for each port on
+ * every frame plus reset events, tied to a rom by its hash. Playing one back
+ * from power on reproduces the run exactly.
+ *
+ * While recording, the keyboard is sampled once per frame (at the frame's
+ * first latch) and held for the rest of it, which is exactly what playback
+ * can reproduce.
+ *
+ * File layout (little-endian):
+ *   header: magic "NMV\x1A" | u32 version | u64 rom hash | u32 frame count
+ *   frames: u8 port 0 | u8 port 1 | u8 flags (MOVIE_RESET: reset before it)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <movie.h>
+#include <mem.h>
+
+#define MOVIE_MAGIC "NMV\x1A"
+#define MOVIE_VERSION 1
+#define MOVIE_HEADER_SIZE 20
+#define MOVIE_FRAME_SIZE 3
+
+#define MOVIE_RESET (1 << 0)
+
+enum movie_mode {
+    MOVIE_OFF,
+    MOVIE_RECORD,
+    MOVIE_PLAY,
+};
+static _Thread_local enum movie_mode mode = MOVIE_OFF;
+
+static _Thread_local FILE *mfile = NULL;
+static _Thread_local u64 rom_hash;
+static _Thread_local u32 frame;      // current frame
+static _Thread_local u32 num_frames; // total frames in the movie
+
+// input for the current frame
+static _Thread_local u8 latch[2];
+static _Thread_local bool latched;
+static _Thread_local u8 flags;
+
+static bool hash_file(const char *path, u64 *hash)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror("fopen");
+        ERROR("Failed to open %s\n", path);
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    u8 *buf = malloc(len > 0 ? len : 1);
+    if (buf == NULL) {
+        ERROR("Out of Host Memory!\n");
+        fclose(file);
+        return false;
+    }
+    size_t got = fread(buf, 1, len, file);
+    fclose(file);
+    *hash = Utils_Hash64(buf, got, 0);
+    free(buf);
+    return true;
+}
+
+static void put_le(u8 *p, u64 v, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        p[i] = (v >> (8 * i)) & 0xFF;
+    }
+}
+
+static u64 get_le(const u8 *p, int bytes)
+{
+    u64 v = 0;
+    for (int i = 0; i < bytes; i++) {
+        v |= (u64) p[i] << (8 * i);
+    }
+    return v;
+}
+
+static void write_header()
+{
+    u8 hdr[MOVIE_HEADER_SIZE];
+    memcpy(&hdr[0], MOVIE_MAGIC, 4);
+    put_le(&hdr[4], MOVIE_VERSION, 4);
+    put_le(&hdr[8], rom_hash, 8);
+    put_le(&hdr[16], num_frames, 4);
+    fwrite(hdr, 1, MOVIE_HEADER_SIZE, mfile);
+}
+
+// load the next frame's input during playback
+static void read_frame()
+{
+    u8 rec[MOVIE_FRAME_SIZE];
+    if (frame >= num_frames || fread(rec, 1, MOVIE_FRAME_SIZE, mfile) != MOVIE_FRAME_SIZE) {
+        INFO("Movie finished after %u frames, back to live input\n", frame);
+        Movie_Close();
+        return;
+    }
+    latch[0] = rec[0];
+    latch[1] = rec[1];
+    flags = rec[2];
+}
+
+// false if either file can't be opened, nothing is recorded then
+bool Movie_Record(const char *path, const char *rompath)
+{
+    assert(mode == MOVIE_OFF);
+    if (!hash_file(rompath, &rom_hash)) {
+        return false;
+    }
+    mfile = fopen(path, "wb");
+    if (mfile == NULL) {
+        perror("fopen");
+        ERROR("Failed to open %s\n", path);
+        return false;
+    }
+    frame = 0;
+    num_frames = 0;
+    latched = false;
+    flags = 0;
+    // frame count gets filled in on close
+    write_header();
+    mode = MOVIE_RECORD;
+    INFO("Recording movie to %s\n", path);
+    return true;
+}
+
+// check the movie's header against rompath, false if the movie can't be
+// played with it
+static bool check_header(const char *path, const char *rompath)
+{
+    u8 hdr[MOVIE_HEADER_SIZE];
+    if (fread(hdr, 1, MOVIE_HEADER_SIZE, mfile) != MOVIE_HEADER_SIZE
+            || memcmp(hdr, MOVIE_MAGIC, 4) != 0) {
+        ERROR("%s is not a movie\n", path);
+        return false;
+    }
+    if (get_le(&hdr[4], 4) != MOVIE_VERSION) {
+        ERROR("Movie version %u not supported\n", (u32) get_le(&hdr[4], 4));
+        return false;
+    }
+    u64 hash;
+    if (!hash_file(rompath, &hash)) {
+        return false;
+    }
+    rom_hash = get_le(&hdr[8], 8);
+    if (rom_hash != hash) {
+        ERROR("Movie was recorded with a different rom\n");
+        return false;
+    }
+    num_frames = get_le(&hdr[16], 4);
+    return true;
+}
+
+// false if the movie can't be opened or wasn't made with rompath, nothing
+// plays then
+bool Movie_Play(const char *path, const char *rompath)
+{
+    assert(mode == MOVIE_OFF);
+    mfile = fopen(path, "rb");
+    if (mfile == NULL) {
+        perror("fopen");
+        ERROR("Failed to open %s\n", path);
+        return false;
+    }
+    if (!check_header(path, rompath)) {
+        fclose(mfile);
+        mfile = NULL;
+        return false;
+    }
+    frame = 0;
+    mode = MOVIE_PLAY;
+    INFO("Playing movie %s (%u frames)\n", path, num_frames);
+    read_frame();
+    return true;
+}
+
+bool Movie_Active()
+{
+    return mode != MOVIE_OFF;
+}
+
+// value the controller shift register for port latches on strobe
+u8 Movie_Latch(int port)
+{
+    assert(port == 0 || port == 1);
+    switch (mode) {
+    case MOVIE_RECORD:
+        // hold the first sample of the frame so playback can match it
+        if (!latched) {
+            latch[0] = Mem_GetInput(0);
+            latch[1] = Mem_GetInput(1);
+            latched = true;
+        }
+        return latch[port];
+    case MOVIE_PLAY:
+        return latch[port];
+    default:
+        return Mem_GetInput(port);
+    }
+}
+
+// call once the ppu finishes a frame. during playback, returns true if the
+// machine must be reset before the next frame.
+bool Movie_FrameEnd()
+{
+    switch (mode) {
+    case MOVIE_RECORD: {
+        if (!latched) {
+            // game didn't read the pad this frame, record what it would've seen
+            latch[0] = Mem_GetInput(0);
+            latch[1] = Mem_GetInput(1);
+        }
+        u8 rec[MOVIE_FRAME_SIZE] = {latch[0], latch[1], flags};
+        fwrite(rec, 1, MOVIE_FRAME_SIZE, mfile);
+        frame++;
+        num_frames++;
+        latched = false;
+        flags = 0;
+        return false;
+    }
+    case MOVIE_PLAY:
+        frame++;
+        read_frame();
+        return mode == MOVIE_PLAY && (flags & MOVIE_RESET);
+    default:
+        return false;
+    }
+}
+
+// the machine is being reset before the next frame
+void Movie_Reset()
+{
+    if (mode == MOVIE_RECORD) {
+        flags |= MOVIE_RESET;
+    }
+}
+
+void Movie_Close()
+{
+    if (mode == MOVIE_OFF) {
+        return;
+    }
+    if (mode == MOVIE_RECORD) {
+        fseek(mfile, 0, SEEK_SET);
+        write_header();
+        INFO("Recorded %u frames\n", num_frames);
+    }
+    fclose(mfile);
+    mfile = NULL;
+    mode = MOVIE_OFF;
+}
@@ -10,15 +10,24 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <SDL3/SDL_main.h>
 
 #include <utils.h>
+#include <libnes.h>
 #include <mem.h>
 #include <cart.h>
-#include <cpu.h>
-#include <ppu.h>
 #include <apu.h>
 #include <vac.h>
+#include <stems.h>
+#include <state.h>
+#include <rewind.h>
+#include <movie.h>
+#include <framehash.h>
+#include <sav.h>
 
 static void sighandler(int sig)
 {
@@ -34,28 +43,260 @@ static void sighandler(int sig)
     EXIT(1);
 }
 
+// emulator state is per thread, only the emulation thread has anything to dump
+static _Thread_local bool is_emu_thread = false;
+
 static void exit_handler(int rc)
 {
-    if (rc != OK) {
+    // battery saves first, whatever killed us
+    Sav_SyncAll();
+    if (rc != OK && is_emu_thread) {
         Mem_Dump();
         Cart_Dump();
         Ppu_Dump();
     }
+    Stems_Close();
+    Movie_Close();
+    FrameHash_Close();
+    Rewind_Free();
     Neslog_Free();
     Vac_Free();
 }
 
-static void run(const char *title, bool dbg_mode)
+// emulation runs on its own thread, the main thread only handles sdl
+// events and presents finished frames
+typedef struct emu_args {
+    const char *rompath;
+    const char *title;
+    const char *state_path;
+    const char *save_path;
+    const char *romdb_path;
+    const char *record_path;
+    const char *play_path;
+    bool dbg_mode;
+} emu_args_t;
+static atomic_bool emu_quit = false;
+
+// an ntsc frame is 29780.5 cpu cycles at 1.789773 MHz (~60.0988 Hz)
+#define FRAME_NS 16639267ULL
+// never owe the emulation more than this many frames (after a stall or a
+// breakpoint we just pick back up instead of fast forwarding)
+#define MAX_FRAMES_OWED 3
+
+// with vsync the main thread's presents are the clock: every refresh it
+// hands the emulation thread credit for however many nes frames fit in the
+// time that passed. without vsync the emulation thread paces itself.
+static bool vsync = false;
+static atomic_uint frame_credits = 0;
+
+// fast forward: run uncapped and only present every nth frame, the ppu
+// doesn't compose pixels for the frames in between
+#define TURBO_DEFAULT_N 8
+
+#define REWIND_DEFAULT_SECS 60
+
+// run-ahead: every host frame runs the real frame (audio only), snapshots,
+// runs this many frames further with the same input, shows the last one
+// and restores the snapshot. hides that many frames of the game's own
+// input lag.
+#define MAX_RUN_AHEAD 3
+static int run_ahead = 0;
+static u8 *run_ahead_state = NULL;
+static size_t run_ahead_state_size = 0;
+// cost accounting
+static u64 ra_frames;
+static u64 ra_real_ns;
+static u64 ra_ahead_ns;
+static u64 ra_snapshot_ns;
+static bool turbo = false;
+static int turbo_n = TURBO_DEFAULT_N;
+
+// ring of recent presented frame times, for jitter stats
+#define FRAME_TIMES_LEN 1024
+static u64 frame_times[FRAME_TIMES_LEN];
+static u32 frame_times_count = 0;
+
+static void pace_frame(u64 *deadline)
+{
+    if (vsync) {
+        // wait for the presentation side to hand out another frame
+        while (atomic_load_explicit(&frame_credits, memory_order_acquire) == 0) {
+            if (atomic_load_explicit(&emu_quit, memory_order_relaxed)) {
+                return;
+            }
+            Vac_DelayNs(250 * 1000);
+        }
+        atomic_fetch_sub_explicit(&frame_credits, 1, memory_order_acq_rel);
+        return;
+    }
+
+    // absolute deadlines so sleep overshoot doesn't accumulate as drift
+    *deadline += FRAME_NS;
+    u64 now = Vac_NowNs();
+    if (now < *deadline) {
+        Vac_DelayNs(*deadline - now);
+    } else if (now - *deadline > MAX_FRAMES_OWED * FRAME_NS) {
+        // way behind, resync instead of racing to catch up
+        *deadline = now;
+    }
+}
+
+static void credit_frames(u64 elapsed)
+{
+    static u64 acc = 0;
+
+    acc += elapsed;
+    if (acc > MAX_FRAMES_OWED * FRAME_NS) {
+        acc = MAX_FRAMES_OWED * FRAME_NS;
+    }
+    u32 due = acc / FRAME_NS;
+    acc -= due * FRAME_NS;
+    if (due == 0) {
+        return;
+    }
+    // don't pile up credit if the emulation is falling behind
+    u32 owed = atomic_load_explicit(&frame_credits, memory_order_relaxed);
+    if (owed + due > MAX_FRAMES_OWED) {
+        due = owed < MAX_FRAMES_OWED ? MAX_FRAMES_OWED - owed : 0;
+    }
+    atomic_fetch_add_explicit(&frame_credits, due, memory_order_release);
+}
+
+static void record_frame_time(u64 ns)
+{
+    frame_times[frame_times_count % FRAME_TIMES_LEN] = ns;
+    frame_times_count++;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    u64 x = *(const u64 *) a;
+    u64 y = *(const u64 *) b;
+    return (x > y) - (x < y);
+}
+
+static void report_frame_times()
+{
+    static u64 sorted[FRAME_TIMES_LEN];
+
+    u32 n = frame_times_count < FRAME_TIMES_LEN ? frame_times_count : FRAME_TIMES_LEN;
+    if (n == 0) {
+        return;
+    }
+    memcpy(sorted, frame_times, n * sizeof(u64));
+    qsort(sorted, n, sizeof(u64), cmp_u64);
+
+    double p50 = sorted[n * 50 / 100] / 1e6;
+    double p90 = sorted[n * 90 / 100] / 1e6;
+    double p99 = sorted[n * 99 / 100] / 1e6;
+    double max = sorted[n - 1] / 1e6;
+    INFO("Frame time over last %u frames: p50 %.3f ms | p90 %.3f ms | p99 %.3f ms | max %.3f ms | jitter (p99-p50) %.3f ms\n",
+        n, p50, p90, p99, max, p99 - p50);
+}
+
+static void save_state(const char *path)
+{
+    u64 start = Vac_NowNs();
+    if (State_SaveFile(path)) {
+        INFO("Saved state to %s (%lu bytes, %.1f us)\n", path,
+            (unsigned long) State_Size(), (Vac_NowNs() - start) / 1000.0);
+    }
+}
+
+static void load_state(const char *path)
+{
+    u64 start = Vac_NowNs();
+    if (State_LoadFile(path)) {
+        INFO("Loaded state from %s (%.1f us)\n", path, (Vac_NowNs() - start) / 1000.0);
+    }
+}
+
+// hand the samples from the last step to the audio device
+static void queue_audio()
+{
+    size_t count;
+    const float *samples = Nes_Audio(&count);
+    Vac_QueueAudio(samples, count * sizeof(float));
+}
+
+static void draw_pattern_tables(u8 pal_id)
+{
+    static nes_color_t pt[128*128];
+    for (int table = 0; table < 2; table++) {
+        Ppu_DrawPT(table, pal_id, pt);
+        for (u16 y = 0; y < 128; y++) {
+            for (u16 x = 0; x < 128; x++) {
+                Vac_SetPxPt(table, x, y, pt[y * 128 + x]);
+            }
+        }
+    }
+}
+
+// one host frame with run-ahead, leaves the newest hidden frame in the frame
+// buffer and the machine right after the real frame
+static u32 run_ahead_frame()
+{
+    if (run_ahead_state == NULL || run_ahead_state_size != Nes_StateSize()) {
+        free(run_ahead_state);
+        run_ahead_state_size = Nes_StateSize();
+        run_ahead_state = malloc(run_ahead_state_size);
+        if (run_ahead_state == NULL) {
+            ERROR("Out of Host Memory!\n");
+            EXIT(1);
+        }
+    }
+
+    // the real frame: audible but never shown
+    u64 t0 = Vac_NowNs();
+    Nes_SetSkipRender(true);
+    u32 cycles = Nes_StepFrame();
+    queue_audio();
+    u64 t1 = Vac_NowNs();
+    Nes_SaveState(run_ahead_state);
+    u64 t2 = Vac_NowNs();
+
+    // speculate ahead with the same input, silent, only the last is drawn
+    Nes_SetAudioOutput(false);
+    for (int i = 1; i <= run_ahead; i++) {
+        Nes_SetSkipRender(i != run_ahead);
+        Nes_StepFrame();
+    }
+    u64 t3 = Vac_NowNs();
+    Nes_LoadState(run_ahead_state, run_ahead_state_size);
+    Nes_SetAudioOutput(true);
+    u64 t4 = Vac_NowNs();
+
+    ra_frames++;
+    ra_real_ns += t1 - t0;
+    ra_ahead_ns += t3 - t2;
+    ra_snapshot_ns += (t2 - t1) + (t4 - t3);
+    return cycles;
+}
+
+static void report_run_ahead()
+{
+    if (ra_frames == 0) {
+        return;
+    }
+    double real = ra_real_ns / 1000.0 / ra_frames;
+    double ahead = ra_ahead_ns / 1000.0 / ra_frames / run_ahead;
+    double snap = ra_snapshot_ns / 1000.0 / ra_frames;
+    INFO("Run-ahead %d over %lu frames: real frame %.1f us | each run-ahead frame +%.1f us (%.0f%%) | save+restore %.1f us | total +%.0f%% cpu\n",
+        run_ahead, (unsigned long) ra_frames, real, ahead, 100.0 * ahead / real, snap,
+        100.0 * (ahead * run_ahead + snap) / real);
+}
+
+static void run(const char *title, const char *state_path, bool dbg_mode)
 {
     char title_fps[128];
     char fps[64];
 
-    unsigned int last_frame_ms = Vac_Now();
+    u64 deadline = Vac_NowNs();
 
-    // int limit = 9000;
-    // int rounds = 0;
-    u32 cycles = 0;
     u32 num_frames = 0;
+    u32 frame_seq = 0;
+    bool showing = true;
+    u32 last_kc = 0;
     u32 cpf = 0;
     u32 mcpf = 0;
     // bool paused = true; // NOTE: TESTING
@@ -63,10 +304,14 @@ static void run(const char *title, bool dbg_mode)
     // bool frame_mode = true; // NOTE: TESTING
     bool frame_mode = false;
     bool frame_finished = false;
+    bool reset_pending = false;
     u8 pal_id = 1;
-    while (true) {
-        // poll keyboard
-        u32 kc = Vac_Poll();
+    while (!atomic_load_explicit(&emu_quit, memory_order_relaxed)) {
+        // latest keyboard snapshot from the main thread
+        u32 kc = Vac_Keys();
+        // one keyboard, it feeds both pads
+        Nes_SetInput(0, kc & 0xFF);
+        Nes_SetInput(1, kc & 0xFF);
         if (kc & KEY_PAUSE) {
             paused = true;
         } else if (kc & KEY_CONTINUE) {
@@ -76,7 +321,45 @@ static void run(const char *title, bool dbg_mode)
             frame_mode = !frame_mode;
             paused = true;
         } else if (kc & KEY_RESET) {
-            return;
+            if (!Movie_Active()) {
+                return;
+            }
+            // movies only reset between frames
+            reset_pending = true;
+        }
+
+        // keys that act once per press
+        u32 pressed = kc & ~last_kc;
+        last_kc = kc;
+        if (pressed & KEY_TURBO) {
+            turbo = !turbo;
+            deadline = Vac_NowNs();
+        }
+        // debug mute channels
+        if (pressed & KEY_MUTE_1) {
+            Apu_ToggleMute(STEM_PULSE1);
+        }
+        if (pressed & KEY_MUTE_2) {
+            Apu_ToggleMute(STEM_PULSE2);
+        }
+        if (pressed & KEY_MUTE_3) {
+            Apu_ToggleMute(STEM_TRIANGLE);
+        }
+        if (pressed & KEY_MUTE_4) {
+            Apu_ToggleMute(STEM_NOISE);
+        }
+        if (pressed & KEY_MUTE_5) {
+            Apu_ToggleMute(STEM_DMC);
+        }
+        if (pressed & KEY_SAVE_STATE) {
+            save_state(state_path);
+        }
+        if (pressed & KEY_LOAD_STATE) {
+            if (Movie_Active()) {
+                WARNING("Can't load a state while a movie is active\n");
+            } else {
+                load_state(state_path);
+            }
         }
 
         // update palette for debug display
@@ -90,46 +373,71 @@ static void run(const char *title, bool dbg_mode)
         }
 
         // execution of cpu, ppu, and apu
-        if (!paused || (kc & KEY_STEP) || (frame_mode && !frame_finished)) {
-            // if we aren't in step mode, we advance cpu n many cycles
-            if (kc & KEY_STEP) {
-                cycles = Cpu_Step();
-            } else {
-                while (cycles < 10) {
-                    cycles += Cpu_Step();
-                }
-            }
-            frame_finished = Ppu_Step(3 * cycles);
-            Apu_Step(cycles / 2, kc);
-            cpf += cycles;
-            cycles = 0;
+        if (run_ahead > 0 && !paused && !turbo && !(kc & KEY_REWIND)) {
+            cpf += run_ahead_frame();
+            frame_finished = true;
+        } else if (kc & KEY_STEP) {
+            // a single instruction
+            frame_finished = Nes_StepCycles(1);
+            queue_audio();
+        } else if (!paused || (frame_mode && !frame_finished)) {
+            cpf += Nes_StepFrame();
+            queue_audio();
+            frame_finished = true;
         }
 
         // change pallete on debug display
         if (kc & KEY_PAL_CHANGE && dbg_mode && paused) {
-            Ppu_DrawPT(0, pal_id - 1);
-            Ppu_DrawPT(1, pal_id - 1);
-            Vac_Refresh();
+            draw_pattern_tables(pal_id - 1);
         }
 
         // update screen on frame finish
         if (frame_finished || (kc & KEY_STEP)) {
             // debug
             if (dbg_mode) {
-                Ppu_DrawPT(0, pal_id - 1);
-                Ppu_DrawPT(1, pal_id - 1);
+                draw_pattern_tables(pal_id - 1);
+            }
+
+            // the regression hash stream sees every frame
+            bool publish = showing || !frame_finished;
+            u64 hash = 0;
+            if (publish || FrameHash_Active()) {
+                hash = Nes_HashFrame();
+            }
+            if (frame_finished && FrameHash_Active()) {
+                FrameHash_Push(hash);
             }
 
+            // fast forward only shows every nth frame
+            if (publish) {
+                Vac_PublishFrame(Nes_Frame(), hash);
+            }
+            if (frame_finished) {
+                // holding rewind plays the history backwards, one frame
+                // per frame
+                if (kc & KEY_REWIND) {
+                    Rewind_Pop();
+                } else {
+                    Rewind_Push();
+                }
+
+                // decide if the next frame gets composed at all, the hash
+                // stream needs every frame drawn whether it's shown or not
+                frame_seq++;
+                showing = !turbo || (frame_seq % turbo_n) == 0;
+                Nes_SetSkipRender(!showing && !FrameHash_Active());
+
+                // movie input moves on to the next frame
+                if (Movie_FrameEnd() || reset_pending) {
+                    Movie_Reset();
+                    return;
+                }
+            }
             frame_finished = false;
-            Vac_Refresh();
-            Vac_ClearScreen();
 
-            // one frame should take about 17 ms
-            unsigned int passed;
-            if ((passed = Vac_MsPassedFrom(last_frame_ms)) < 16) {
-                Vac_Delay(16 - passed);
+            if (!turbo) {
+                pace_frame(&deadline);
             }
-            last_frame_ms = Vac_Now();
             num_frames++;
             mcpf = cpf > mcpf ? cpf : mcpf;
             cpf = 0;
@@ -140,7 +448,9 @@ static void run(const char *title, bool dbg_mode)
         if (Vac_OneSecPassed()) {
             // display frame rate
             strncpy(title_fps, title, 64);
-            sprintf(fps, " | %d fps | CPU: %0.3lf MHz", num_frames, 
+            // speed relative to a real ntsc nes (60.0988 fps)
+            sprintf(fps, " | %d fps | %.1fx%s | CPU: %0.3lf MHz", num_frames,
+                num_frames / 60.0988, turbo ? " (turbo)" : "",
                 (double) (mcpf * num_frames) / 1000000.0);
             strncat(title_fps, fps, 64);
             Vac_SetWindowTitle(title_fps);
@@ -160,16 +470,187 @@ static void run(const char *title, bool dbg_mode)
     }
 }
 
+static void usage()
+{
+    fprintf(stderr, "usage: nes [options] <rom path>\n");
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  --backend <sdl|null|file>  where video, audio and input go (default sdl)\n");
+    fprintf(stderr, "  --input <file>  null/file backends: scripted input, \"<frame> <keys...>\" per line\n");
+    fprintf(stderr, "  --out <prefix>  file backend: write <prefix>.rgb and <prefix>.f32 (default: rom path)\n");
+    fprintf(stderr, "  --stems <file>  capture every apu channel plus the mix (.wav or raw f32)\n");
+    fprintf(stderr, "  --vsync         present on display refresh, emulate the frames each refresh owes\n");
+    fprintf(stderr, "  --frame-stats   report frame time percentiles every few seconds\n");
+    fprintf(stderr, "  --record <file>  record an input movie from power on\n");
+    fprintf(stderr, "  --play <file>    play back an input movie\n");
+    fprintf(stderr, "  --hash-out <file>    write a hash of every frame\n");
+    fprintf(stderr, "  --hash-golden <file> compare every frame's hash against a --hash-out file\n");
+    fprintf(stderr, "  --rewind <secs> seconds of rewind history, 0 to disable (default %d)\n", REWIND_DEFAULT_SECS);
+    fprintf(stderr, "  --run-ahead <n> run n (1-%d) frames ahead to hide input lag\n", MAX_RUN_AHEAD);
+    fprintf(stderr, "  --turbo[=N]     start in fast forward, showing every Nth frame (default %d)\n", TURBO_DEFAULT_N);
+    fprintf(stderr, "  --romdb <file>  fix rom headers from a database built by nes-romdb\n");
+}
+
+static void *emu_main(void *arg)
+{
+    emu_args_t *args = arg;
+    is_emu_thread = true;
+
+    // init hw, all of its state lives on this thread
+    Nes_Init();
+    if (args->record_path != NULL && !Movie_Record(args->record_path, args->rompath)) {
+        EXIT(1);
+    } else if (args->play_path != NULL && !Movie_Play(args->play_path, args->rompath)) {
+        EXIT(1);
+    }
+    Nes_SetSaveFile(args->save_path);
+    if (args->romdb_path != NULL && !Nes_SetRomDb(args->romdb_path)) {
+        EXIT(1);
+    }
+    if (!Nes_LoadRomFile(args->rompath)) {
+        EXIT(1);
+    }
+
+    // run only returns on NES RESET (or when told to quit)
+    while (true) {
+        Rewind_Clear();
+        run(args->title, args->state_path, args->dbg_mode);
+        if (atomic_load(&emu_quit)) {
+            break;
+        }
+        Nes_Reset();
+    }
+    Movie_Close();
+    return NULL;
+}
+
 int main(int argc, char **argv)
 {
-    (void) argc, (void) argv;
+    static struct option long_opts[] = {
+        {"backend", required_argument, NULL, 'b'},
+        {"input", required_argument, NULL, 'i'},
+        {"out", required_argument, NULL, 'o'},
+        {"stems", required_argument, NULL, 's'},
+        {"vsync", no_argument, NULL, 'v'},
+        {"frame-stats", no_argument, NULL, 'f'},
+        {"turbo", optional_argument, NULL, 't'},
+        {"rewind", required_argument, NULL, 'r'},
+        {"record", required_argument, NULL, 'R'},
+        {"play", required_argument, NULL, 'P'},
+        {"hash-out", required_argument, NULL, 'h'},
+        {"hash-golden", required_argument, NULL, 'g'},
+        {"run-ahead", required_argument, NULL, 'a'},
+        {"romdb", required_argument, NULL, 'd'},
+        {NULL, 0, NULL, 0},
+    };
 
-    if (argc != 2) {
-        fprintf(stderr, "usage: nes <rom path>\n");
+    vac_config_t vac_cfg = {VAC_SDL, NULL, false, false, NULL, NULL};
+    char *stems_path = NULL;
+    bool frame_stats = false;
+    char *record_path = NULL;
+    char *play_path = NULL;
+    char *hash_path = NULL;
+    char *golden_path = NULL;
+    char *romdb_path = NULL;
+    int rewind_secs = REWIND_DEFAULT_SECS;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'b':
+            if (strcmp(optarg, "sdl") == 0) {
+                vac_cfg.backend = VAC_SDL;
+            } else if (strcmp(optarg, "null") == 0) {
+                vac_cfg.backend = VAC_NULL;
+            } else if (strcmp(optarg, "file") == 0) {
+                vac_cfg.backend = VAC_FILE;
+            } else {
+                ERROR("Unknown backend: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'i':
+            vac_cfg.input_script = optarg;
+            break;
+        case 'o':
+            vac_cfg.out_prefix = optarg;
+            break;
+        case 's':
+            stems_path = optarg;
+            break;
+        case 'v':
+            vsync = true;
+            break;
+        case 'f':
+            frame_stats = true;
+            break;
+        case 'r':
+            rewind_secs = atoi(optarg);
+            if (rewind_secs < 0) {
+                ERROR("Invalid rewind length: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'R':
+            record_path = optarg;
+            break;
+        case 'P':
+            play_path = optarg;
+            break;
+        case 'h':
+            hash_path = optarg;
+            break;
+        case 'g':
+            golden_path = optarg;
+            break;
+        case 'd':
+            romdb_path = optarg;
+            break;
+        case 'a':
+            run_ahead = atoi(optarg);
+            if (run_ahead < 1 || run_ahead > MAX_RUN_AHEAD) {
+                ERROR("Run-ahead must be 1-%d frames\n", MAX_RUN_AHEAD);
+                return 1;
+            }
+            break;
+        case 't':
+            turbo = true;
+            if (optarg != NULL) {
+                turbo_n = atoi(optarg);
+                if (turbo_n < 1) {
+                    ERROR("Invalid turbo frame skip: %s\n", optarg);
+                    return 1;
+                }
+            }
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (argc - optind != 1) {
+        usage();
         return 1;
     }
 
-    char *rompath = argv[1];
+    char *rompath = argv[optind];
+
+    if (record_path != NULL && play_path != NULL) {
+        ERROR("Can't record and play a movie at the same time\n");
+        return 1;
+    }
+    if (record_path != NULL || play_path != NULL) {
+        // anything that rewrites machine state would desync the movie
+        if (run_ahead > 0) {
+            WARNING("Run-ahead is disabled while a movie is active\n");
+            run_ahead = 0;
+        }
+        rewind_secs = 0;
+    }
+    if ((hash_path != NULL || golden_path != NULL) && run_ahead > 0) {
+        // the shown frames would be speculative ones
+        WARNING("Run-ahead is disabled while hashing frames\n");
+        run_ahead = 0;
+    }
 
     int rc;
 
@@ -190,31 +671,86 @@ int main(int argc, char **argv)
     // Neslog_Add(LID_PPU, "ppu.log");
     // Neslog_Add(LID_PPU, NULL);
 
-    // init hw
-    Mem_Init();
-    Cart_Init();
-    Cpu_Init();
-    Ppu_Init();
-    Apu_Init();
+    if (stems_path != NULL) {
+        Stems_Open(stems_path, APU_SAMPLE_RATE);
+    }
+    if (rewind_secs > 0) {
+        Rewind_Init(rewind_secs);
+    }
+    if (hash_path != NULL || golden_path != NULL) {
+        FrameHash_Open(hash_path, golden_path);
+    }
     char title[64] = "NES - ";
     strncat(title, rompath, 64);
     bool dbg_mode = false;
-    Vac_Init(title, dbg_mode);
+    if (vac_cfg.input_script != NULL && vac_cfg.backend == VAC_SDL) {
+        WARNING("Input scripts only drive the null and file backends\n");
+    }
+    if (vac_cfg.out_prefix == NULL) {
+        vac_cfg.out_prefix = rompath;
+    }
+    vac_cfg.title = title;
+    vac_cfg.debug_display = dbg_mode;
+    vac_cfg.vsync = vsync;
+    Vac_Init(&vac_cfg);
+
+    // save states live next to the rom
+    char state_path[1024];
+    snprintf(state_path, sizeof(state_path), "%s.state", rompath);
 
-    // run only returns on NES RESET
-    while (1) {
-        // NOTE: cartridge must be loaded before any other reset
-        Cart_Load(rompath);
+    // battery saves too, but movies and hash runs always start from blank
+    // cartridge ram
+    char save_path[1024];
+    snprintf(save_path, sizeof(save_path), "%s.sav", rompath);
+    bool use_save = record_path == NULL && play_path == NULL
+        && hash_path == NULL && golden_path == NULL;
 
-        Cpu_Reset();
-        Ppu_Reset();
-        Apu_Reset();
-        run(title, dbg_mode);
-        Vac_ClearScreen();
+    emu_args_t args = {rompath, title, state_path, use_save ? save_path : NULL, romdb_path,
+        record_path, play_path, dbg_mode};
+    pthread_t emu_thread;
+    rc = pthread_create(&emu_thread, NULL, emu_main, &args);
+    if (rc != 0) {
+        ERROR("Failed to start emulation thread\n");
+        EXIT(1);
     }
 
-    Vac_Free();
-    Neslog_Free();
+    // present frames as they come in until the window is closed
+    u64 last_refresh = Vac_NowNs();
+    u64 last_frame = last_refresh;
+    u64 last_report = last_refresh;
+    while (!(Vac_Poll() & KEY_QUIT)) {
+        // with vsync this blocks until the next refresh
+        bool presented = Vac_Refresh(vsync);
+        u64 now = Vac_NowNs();
+        if (vsync) {
+            credit_frames(now - last_refresh);
+            last_refresh = now;
+        }
+        if (presented) {
+            record_frame_time(now - last_frame);
+            last_frame = now;
+        } else if (!vsync && vac_cfg.backend == VAC_SDL) {
+            // nothing new yet, don't spin
+            Vac_Delay(1);
+        } else if (!vsync) {
+            // headless clocks are virtual and only the emulation thread may
+            // move them, just let it run
+            sched_yield();
+        }
+        if (frame_stats && now - last_report >= 5000000000ULL) {
+            report_frame_times();
+            last_report = now;
+        }
+    }
+
+    atomic_store(&emu_quit, true);
+    pthread_join(emu_thread, NULL);
+    if (frame_stats) {
+        report_frame_times();
+    }
+    report_run_ahead();
+    u32 mismatches = FrameHash_Close();
+    EXIT(mismatches > 0 ? ERR : OK);
     return 0;
 }
 
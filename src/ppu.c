@@ -10,16 +10,19 @@
 #include <string.h>
 
 #include <utils.h>
+#include <ppu.h>
 #include <mem.h>
-#include <vac.h>
 #include <cpu.h>
+#include <cart.h>
+#include <scheduler.h>
+#include <state.h>
 
 #define LOG(fmt, ...) Neslog_Log(LID_PPU, fmt, ##__VA_ARGS__);
-static bool is_init = false;
+static _Thread_local bool is_init = false;
 #define CHECK_INIT if(!is_init){ERROR("Not Initialized!\n"); EXIT(1);}
 
 // Object Attrubute Memory (holds 64 sprites)
-static u8 oam[64*4] = {0};
+static _Thread_local u8 oam[64*4] = {0};
 // Sprite Struct
 typedef struct sprite {
     u8 ypos;
@@ -39,7 +42,7 @@ typedef struct sprite {
     u8 xpos;
 } sprite_t;
 // Secondary OAM (holds 8 sprites)
-static u8 oambuf[8*4];
+static _Thread_local u8 oambuf[8*4];
 
 typedef struct oam_entry {
     u8 y;    // sprite y-coordinate
@@ -63,7 +66,7 @@ typedef union reg_ppuctrl {
     } field;
     u8 raw;
 } reg_ppuctrl_t;
-static reg_ppuctrl_t ppuctrl;
+static _Thread_local reg_ppuctrl_t ppuctrl;
 
 // $2001
 typedef union reg_ppumask {
@@ -79,7 +82,7 @@ typedef union reg_ppumask {
     } field;
     u8 raw;
 } reg_ppumask_t;
-static reg_ppumask_t ppumask;
+static _Thread_local reg_ppumask_t ppumask;
 
 // $2002
 typedef union reg_ppustatus {
@@ -91,10 +94,10 @@ typedef union reg_ppustatus {
     } field;
     u8 raw;
 } reg_ppustatus_t;
-static reg_ppustatus_t ppustatus;
+static _Thread_local reg_ppustatus_t ppustatus;
 
 // $2003
-static u8 oamaddr;
+static _Thread_local u8 oamaddr;
 
 // $2006
 // https://wiki.nesdev.com/w/index.php/PPU_scrolling
@@ -109,37 +112,54 @@ typedef union loopyreg {
     } field;
     u16 raw;
 } loopyreg_t;
-static loopyreg_t loopy_v;
-static loopyreg_t loopy_t;
-static u8 fine_x;
+static _Thread_local loopyreg_t loopy_v;
+static _Thread_local loopyreg_t loopy_t;
+static _Thread_local u8 fine_x;
 
 // other state vars
-static bool al_first_write = true;
-static u8 ppudata_buf;
+static _Thread_local bool al_first_write = true;
+static _Thread_local u8 ppudata_buf;
 
 // screen state
 #define NUM_CYCLES 341
 #define NUM_SCANLINES 262
-static int cycle;
-static int scanline;
-static bool oddframe = false;
+static _Thread_local int cycle;
+static _Thread_local int scanline;
+static _Thread_local bool oddframe = false;
+// dots clocked since reset, 3 per cpu cycle so it's always 3 * Sched_Now()
+// between steps (not state, rebuilt from the scheduler on load)
+static _Thread_local u64 dots;
 
 // bg shifters
-static u16 bgshifter_ptrn_lo;
-static u16 bgshifter_ptrn_hi;
-static u16 bgshifter_attr_lo;
-static u16 bgshifter_attr_hi;
+static _Thread_local u16 bgshifter_ptrn_lo;
+static _Thread_local u16 bgshifter_ptrn_hi;
+static _Thread_local u16 bgshifter_attr_lo;
+static _Thread_local u16 bgshifter_attr_hi;
 
 // sprites
-static u8 sprite_shifter_lo[8];
-static u8 sprite_shifter_hi[8];
-static u8 sprites_found = 0;
-static bool sprite0_loaded = false;
+static _Thread_local u8 sprite_shifter_lo[8];
+static _Thread_local u8 sprite_shifter_hi[8];
+static _Thread_local u8 sprites_found = 0;
+static _Thread_local bool sprite0_loaded = false;
+
+// skip pixel composition for frames that won't be shown (fast forward)
+static _Thread_local bool skip_render = false;
+
+// the finished (or in progress) frame
+static _Thread_local nes_color_t frame[PPU_RES_X * PPU_RES_Y];
 
 // tile buffers
-static u8 nx_bgtile_id;
-static u16 nx_bgtile;
-static u8 nx_bgtile_attr;
+static _Thread_local u8 nx_bgtile_id;
+static _Thread_local u16 nx_bgtile;
+static _Thread_local u8 nx_bgtile_attr;
+
+#define PPU_STATE(X) \
+    X(oam) X(oambuf) X(ppuctrl) X(ppumask) X(ppustatus) X(oamaddr) \
+    X(loopy_v) X(loopy_t) X(fine_x) X(al_first_write) X(ppudata_buf) \
+    X(cycle) X(scanline) X(oddframe) \
+    X(bgshifter_ptrn_lo) X(bgshifter_ptrn_hi) X(bgshifter_attr_lo) X(bgshifter_attr_hi) \
+    X(sprite_shifter_lo) X(sprite_shifter_hi) X(sprites_found) X(sprite0_loaded) \
+    X(nx_bgtile_id) X(nx_bgtile) X(nx_bgtile_attr)
 
 // All of the NES Colors
 static nes_color_t nes_colors[] = 
@@ -244,7 +264,21 @@ static void render_px()
         bg_pal = (pal1 << 1) | pal0;
     } 
 
-    if (ppumask.field.render_sprites) {
+    if (skip_render) {
+        // nobody will see this frame, the only thing the cpu can observe
+        // from here is sprite0 hit. sprite0 always sits in slot 0 of the
+        // oam buffer, so only it needs checking.
+        if (bg_px && sprite0_loaded && ppumask.field.render_sprites && cycle < PPU_RES_X) {
+            sprite_t *sprite = (sprite_t *)&oambuf[0];
+            if (sprite->xpos == 0 && ((sprite_shifter_lo[0] | sprite_shifter_hi[0]) & 0x80)) {
+                ppustatus.field.sprite0_hit = 1;
+            }
+        }
+        return;
+    }
+
+    // past the right edge the shifters hold the next line's sprites
+    if (ppumask.field.render_sprites && cycle < PPU_RES_X) {
         for (u16 i = 0; i < sprites_found; i++) {
             assert((i << 2) < (u16) sizeof(oambuf));
             sprite_t *sprite = (sprite_t *)&oambuf[i << 2];
@@ -318,7 +352,9 @@ static void render_px()
     //     col.blue = 0;
     // }
     // draw the pixel
-    Vac_SetPx(cycle, scanline, col);
+    if (cycle >= 0 && cycle < PPU_RES_X && scanline >= 0 && scanline < PPU_RES_Y) {
+        frame[scanline * PPU_RES_X + cycle] = col;
+    }
 }
 
 static void inc_hori()
@@ -436,61 +472,211 @@ static void sprite_eval()
     } 
 }
 
-static void load_sprite_shifters()
+// the pattern fetches for one of the 8 sprite slots. empty slots still
+// fetch (tile $FF), a12 follows them like any other.
+static void load_sprite_slot(u16 i)
 {
-    for (u16 i = 0; i < sprites_found; i++) {
-        // load sprite
-        assert((i << 2) < (u16) sizeof(oambuf));
-        sprite_t *sprite = (sprite_t *)&oambuf[i << 2];
-
-        u16 addr = 0;
-        // first determine size of sprite
-        if (ppuctrl.field.sprite_size == 0) {
-            // 8x8
-            // read attribute from pattern table by choosing the table
-            // side, then choosing the tile in the table (using id)
-            addr = ((u16) ppuctrl.field.sprite_side << 12);
-            addr |= (sprite->id << 4);
-
-            // Now determine orientation to figure out the last offset
-            if ((sprite->attr & 0x80) == 0) {
-                // normal vertically
-                addr |= (scanline - sprite->ypos);
-            } else {
-                // flipped Vertically
-                addr |= (7 - (scanline - sprite->ypos));
-            }
+    if (i >= sprites_found) {
+        u16 addr = ppuctrl.field.sprite_size ? 0x1FE0 : ((u16) ppuctrl.field.sprite_side << 12) | 0x0FF0;
+        (void) Mem_PpuRead(addr);
+        (void) Mem_PpuRead(addr + 8);
+        sprite_shifter_lo[i] = 0;
+        sprite_shifter_hi[i] = 0;
+        return;
+    }
+
+    assert((i << 2) < (u16) sizeof(oambuf));
+    sprite_t *sprite = (sprite_t *)&oambuf[i << 2];
+
+    u16 addr = 0;
+    // first determine size of sprite
+    if (ppuctrl.field.sprite_size == 0) {
+        // 8x8
+        // read attribute from pattern table by choosing the table
+        // side, then choosing the tile in the table (using id)
+        addr = ((u16) ppuctrl.field.sprite_side << 12);
+        addr |= (sprite->id << 4);
+
+        // Now determine orientation to figure out the last offset
+        if ((sprite->attr & 0x80) == 0) {
+            // normal vertically
+            addr |= (scanline - sprite->ypos);
         } else {
-            // 8x16
-            addr = ((u16) (sprite->id & 0x01) << 12);
-            // determine if in top-half of sprite or bottom-half
-            if (scanline - sprite->ypos < 8) {
-                addr |= ((sprite->id & 0xFE) << 4);
-            } else {
-                addr |= (((sprite->id & 0xFE) + 1) << 4);
-            }
+            // flipped Vertically
+            addr |= (7 - (scanline - sprite->ypos));
+        }
+    } else {
+        // 8x16
+        addr = ((u16) (sprite->id & 0x01) << 12);
+        // determine if in top-half of sprite or bottom-half
+        if (scanline - sprite->ypos < 8) {
+            addr |= ((sprite->id & 0xFE) << 4);
+        } else {
+            addr |= (((sprite->id & 0xFE) + 1) << 4);
+        }
 
-            // Now determine orientation
-            if ((sprite->attr & 0x80) == 0) {
-                // normal vertically
-                addr |= ((scanline - sprite->ypos) & 0x07);
-            } else {
-                // flipped Vertically
-                addr |= ((7 - (scanline - sprite->ypos)) & 0x07);
+        // Now determine orientation
+        if ((sprite->attr & 0x80) == 0) {
+            // normal vertically
+            addr |= ((scanline - sprite->ypos) & 0x07);
+        } else {
+            // flipped Vertically
+            addr |= ((7 - (scanline - sprite->ypos)) & 0x07);
+        }
+    } // end of addr calc
+
+    u8 ptrn_lo = Mem_PpuRead(addr);
+    u8 ptrn_hi = Mem_PpuRead(addr + 8);
+
+    // determine if horz flip needed
+    if (sprite->attr & 0x40) {
+        ptrn_lo = Utils_FlipByte(ptrn_lo);
+        ptrn_hi = Utils_FlipByte(ptrn_hi);
+    }
+
+    sprite_shifter_lo[i] = ptrn_lo;
+    sprite_shifter_hi[i] = ptrn_hi;
+}
+
+// *** A12 PREDICTION ***
+// The mmc3 counts rising edges of ppu address line 12 (pattern fetches from
+// $1000-$1FFF after a while at $0000-$0FFF). Instead of watching every fetch
+// we work out where the edges fall from ppuctrl, ppumask and oam: in the
+// sprite fetches at each slot that reads $1000 after one that (or the
+// background) read $0000, and at the background prefetch if the background
+// uses $1000 and the last slot didn't. The cartridge
+// is told before and after anything here changes (Cart_A12Changing and
+// Cart_A12Changed) so it can catch up and predict again.
+// Times are cpu cycles, an edge at dot d counts at cycle ceil(d / 3).
+// https://wiki.nesdev.com/w/index.php/MMC3#IRQ_Specifics
+
+#define A12_SPRITE_DOT 260
+#define A12_BG_DOT 324
+
+static bool rendering()
+{
+    return ppumask.field.render_bg || ppumask.field.render_sprites;
+}
+
+// 8x16 sprites pick their table with bit 0 of the tile id, 8x8 ones all use
+// ppuctrl's. empty slots fetch tile $FF. returns the 8 fetch slots of the
+// line as a mask, bit n set if slot n reads $1000-$1FFF.
+static u8 sprite_slots_hi(int line)
+{
+    if (ppuctrl.field.sprite_size == 0) {
+        return ppuctrl.field.sprite_side ? 0xFF : 0x00;
+    }
+    // nothing is evaluated for the pre-render line
+    u8 hi = 0xFF;
+    int found = 0;
+    for (int i = 0; line >= 0 && i < 64 * 4 && found < 8; i += 4) {
+        int diff = line - (int) oam[i];
+        if (diff >= 0 && diff < 16) {
+            if (!(oam[i + 1] & 0x01)) {
+                hi &= ~(1 << found);
             }
-        } // end of addr calc
+            found++;
+        }
+    }
+    return hi;
+}
 
-        u8 ptrn_lo = Mem_PpuRead(addr);
-        u8 ptrn_hi = Mem_PpuRead(addr + 8);
+// dot of the line's first a12 rise after dot `after` (-1 for the whole
+// line), -1 if there isn't one
+static int a12_rise_dot(int line, int after)
+{
+    // the background fetches of the line before (its prefetch) and this
+    // one's up to the sprites all read the same table, no edges there
+    bool bg_hi = ppuctrl.field.bg_side;
+    if (bg_hi && ppuctrl.field.sprite_size == 0 && ppuctrl.field.sprite_side) {
+        return -1;
+    }
+    u8 slots = sprite_slots_hi(line);
+    bool was_hi = bg_hi;
+    for (int slot = 0; slot < 8; slot++) {
+        bool hi = (slots >> slot) & 1;
+        int dot = A12_SPRITE_DOT + 8 * slot;
+        if (hi && !was_hi && dot > after) {
+            return dot;
+        }
+        was_hi = hi;
+    }
+    return bg_hi && !was_hi && A12_BG_DOT > after ? A12_BG_DOT : -1;
+}
+
+// odd frames skip dot 0 of line 0
+static u64 frame_len(bool odd)
+{
+    return NUM_CYCLES * NUM_SCANLINES - (odd ? 1 : 0);
+}
+
+// absolute dot of the first edge after dot `after`, SCHED_NEVER for none
+static u64 next_a12_rise(u64 after)
+{
+    if (!rendering()) {
+        return SCHED_NEVER;
+    }
+
+    // find the frame holding `after`, stepping from the one we're in
+    u64 pos = (u64) (scanline + 1) * NUM_CYCLES + cycle - (oddframe && scanline >= 0 ? 1 : 0);
+    u64 start = dots - pos;
+    bool odd = oddframe;
+    while (after < start) {
+        odd = !odd;
+        start -= frame_len(odd);
+    }
+    while (after >= start + frame_len(odd)) {
+        start += frame_len(odd);
+        odd = !odd;
+    }
 
-        // determine if horz flip needed
-        if (sprite->attr & 0x40) {
-            ptrn_lo = Utils_FlipByte(ptrn_lo);
-            ptrn_hi = Utils_FlipByte(ptrn_hi);
+    int line = (int) ((after - start) / NUM_CYCLES) - 1;
+    // the dot of `after` in its line, edges up to it are behind us
+    int after_dot = (int) (after - start - (u64) (line + 1) * NUM_CYCLES) + (odd && line >= 0 ? 1 : 0);
+    // give up after a whole frame without an edge
+    for (int lines = 0; lines <= NUM_SCANLINES; lines++) {
+        if (line > 239) {
+            start += frame_len(odd);
+            odd = !odd;
+            line = -1;
+            after_dot = -1;
+        }
+        int dot = a12_rise_dot(line, after_dot);
+        if (dot >= 0) {
+            u64 rise = start + (u64) (line + 1) * NUM_CYCLES + dot - (odd && line >= 0 ? 1 : 0);
+            assert(rise > after);
+            return rise;
         }
+        line++;
+        after_dot = -1;
+    }
+    return SCHED_NEVER;
+}
 
-        sprite_shifter_lo[i] = ptrn_lo;
-        sprite_shifter_hi[i] = ptrn_hi;
+// cpu cycle of the nth edge after cycle `after`, SCHED_NEVER if it never comes
+u64 Ppu_A12Rise(u64 after, u32 n)
+{
+    u64 rise = after * 3;
+    while (n-- > 0) {
+        rise = next_a12_rise(rise);
+        if (rise == SCHED_NEVER) {
+            return SCHED_NEVER;
+        }
+    }
+    return (rise + 2) / 3;
+}
+
+// number of edges after cycle `from` up to and including cycle `to`
+u32 Ppu_A12Rises(u64 from, u64 to)
+{
+    u32 count = 0;
+    u64 rise = from * 3;
+    while (true) {
+        rise = next_a12_rise(rise);
+        if (rise == SCHED_NEVER || rise > to * 3) {
+            return count;
+        }
+        count++;
     }
 }
 
@@ -514,6 +700,7 @@ void Ppu_Reset()
     // setup initial state
     cycle = 0;
     scanline = -1;
+    dots = 0;
     al_first_write = true;
     ppudata_buf = 0;
     oddframe = false;
@@ -539,6 +726,7 @@ void Ppu_Reset()
     memset(sprite_shifter_hi, 0, 8);
     sprites_found = 0;
     sprite0_loaded = false;
+    skip_render = false;
     memset(oambuf, 0xFF, sizeof(oambuf));
     memset(oam, 0xFF, sizeof(oam));
 }
@@ -558,6 +746,10 @@ bool Ppu_Step(int clock_budget)
 
         // free cycle on oddframes
         if (scanline == 0 && cycle == 0 && oddframe) {
+            // still draw the pixel for dot 0, otherwise (0, 0) keeps whatever
+            // the recycled frame buffer held and frame hashes stop being
+            // reproducible
+            render_px();
             cycle = 1;
         }
 
@@ -652,14 +844,19 @@ bool Ppu_Step(int clock_budget)
 
             // simple sprite evaluation (not cycle accurate)
             // NOTE: Maybe spread out workload across cycles??
-            if (cycle == 257 && scanline >= 0) {
+            // nothing is evaluated for the pre-render line, its fetches are
+            // all empty slots
+            if (cycle == 257) {
                 sprites_found = 0;
-                sprite_eval();
+                if (scanline >= 0) {
+                    sprite_eval();
+                }
             }
-            
-            // find corresponding pattern attributes for sprites
-            if (cycle == 340) {
-                load_sprite_shifters();
+
+            // find corresponding pattern attributes for sprites, one slot
+            // every 8 dots like the real fetches
+            if (cycle >= 261 && cycle <= 317 && (cycle - 261) % 8 == 0 && rendering()) {
+                load_sprite_slot((cycle - 261) / 8);
             }
             // *** END Sprites ***
 
@@ -690,9 +887,23 @@ bool Ppu_Step(int clock_budget)
             cycle++;
         }
     }
+    dots += clock_budget;
     return frame_finished;
 }
 
+// skip composing pixels until turned back off, vblank, sprite0 hit and
+// sprite overflow all still behave exactly the same
+void Ppu_SetSkipRender(bool skip)
+{
+    skip_render = skip;
+}
+
+// PPU_RES_X * PPU_RES_Y pixels, rows top to bottom
+const nes_color_t *Ppu_Frame()
+{
+    return frame;
+}
+
 u8 Ppu_RegRead(u16 reg)
 {
 #ifdef DEBUG
@@ -764,14 +975,31 @@ void Ppu_RegWrite(u8 val, u16 reg)
 #ifdef DEBUG
     CHECK_INIT;
 #endif
+    bool a12_change;
     switch (reg) {
     case 0: // PPUCTRL
+        // pattern table sides and sprite size move the a12 edges
+        a12_change = ((val ^ ppuctrl.raw) & 0x38) != 0;
+        if (a12_change) {
+            Cart_A12Changing();
+        }
         ppuctrl.raw = val;
         loopy_t.field.x_nt = ppuctrl.field.x_nt;
         loopy_t.field.y_nt = ppuctrl.field.y_nt;
+        if (a12_change) {
+            Cart_A12Changed();
+        }
         break;
     case 1: // PPUMASK
+        // so does turning rendering on or off
+        a12_change = ((val ^ ppumask.raw) & 0x18) != 0;
+        if (a12_change) {
+            Cart_A12Changing();
+        }
         ppumask.raw = val;
+        if (a12_change) {
+            Cart_A12Changed();
+        }
         break;
     case 2: // PPUSTATUS
         // no write access
@@ -780,8 +1008,16 @@ void Ppu_RegWrite(u8 val, u16 reg)
         oamaddr = val;
         break;
     case 4: // OAMDATA
+        // 8x16 sprites choose their own table
+        a12_change = ppuctrl.field.sprite_size == 1;
+        if (a12_change) {
+            Cart_A12Changing();
+        }
         oam[oamaddr] = val;
         oamaddr++;
+        if (a12_change) {
+            Cart_A12Changed();
+        }
         break;
     case 5: // PPUSCROLL
         if (al_first_write) {
@@ -818,51 +1054,112 @@ void Ppu_Oamdma(u8 hi)
 #ifdef DEBUG
     CHECK_INIT;
 #endif
-    for (u16 lo = 0; lo < 256; lo++) {
-        u16 addr = ((u16)hi) << 8;
-        addr |= lo;
-        u8 val = Mem_CpuRead(addr);
-        oam[oamaddr] = val;
-        oamaddr++;
+    bool a12_change = ppuctrl.field.sprite_size == 1;
+    if (a12_change) {
+        Cart_A12Changing();
+    }
+    const u8 *page = Mem_CpuPage(hi);
+    if (page != NULL) {
+        // ram or rom: copy the page in two pieces, oam wraps from oamaddr
+        u16 first = sizeof(oam) - oamaddr;
+        memcpy(oam + oamaddr, page, first);
+        memcpy(oam, page + first, oamaddr);
+    } else {
+        for (u16 lo = 0; lo < 256; lo++) {
+            u16 addr = ((u16)hi) << 8;
+            addr |= lo;
+            u8 val = Mem_CpuRead(addr);
+            oam[oamaddr] = val;
+            oamaddr++;
+        }
     }
+    if (a12_change) {
+        Cart_A12Changed();
+    }
+    // the cpu is halted while the dma runs
+    Cpu_OamDma();
 }
 
 //---------------------------------------------------------------
 // PPU Debug Display
 //---------------------------------------------------------------
-// Draw the Pattern Table into the Debug Display
-void Ppu_DrawPT(u16 table_id, u8 pal_id)
+// Draw the Pattern Table into a 128x128 buffer for the Debug Display
+// decoded pattern tables (2 bit pixels) for the debug view, only the tiles
+// that changed since the last draw are decoded again
+static _Thread_local u8 pt_px[2][128*128];
+static _Thread_local u64 pt_dirty[CHR_DIRTY_WORDS];
+
+static void decode_tile(u16 tile)
 {
-    for (u16 ytile = 0; ytile < 16; ytile++) {
-        for (u16 xtile = 0; xtile < 16; xtile++) {
-            // convert 2D indexing to 1D indexing
-            u16 byte_offset = (ytile * 256) + (xtile * 16);
-
-            // Now iterate over the bytes in a tile and then each bit in the byte
-            for (u16 row = 0; row < 8; row++) {
-                u16 addr = table_id * 0x1000 + byte_offset + row;
-                u8 tile_lsb = Mem_PpuRead(addr);
-                u8 tile_msb = Mem_PpuRead(addr + 8);
-
-                for (u16 col = 0; col < 8; col++) {
-                    u8 px = ((tile_msb & 0x1) << 1) | (tile_lsb & 0x1);
-                    // shift tile byte
-                    tile_lsb >>= 1;
-                    tile_msb >>= 1;
-
-                    u16 x = (7 - col) + (xtile * 8);
-                    u16 y = row + (ytile * 8);
-
-                    u8 color_id = Mem_PpuRead(0x3F00 + (pal_id << 2) + px);
-                    nes_color_t color = nes_colors[color_id & 0x3F];
-
-                    Vac_SetPxPt(table_id, x, y, color);
-                }
+    u16 table_id = tile >> 8;
+    u16 ytile = (tile >> 4) & 0xF;
+    u16 xtile = tile & 0xF;
+    for (u16 row = 0; row < 8; row++) {
+        u16 addr = tile * CHR_TILE_SIZE + row;
+        u8 tile_lsb = Mem_PpuRead(addr);
+        u8 tile_msb = Mem_PpuRead(addr + 8);
+
+        for (u16 col = 0; col < 8; col++) {
+            u8 px = ((tile_msb & 0x1) << 1) | (tile_lsb & 0x1);
+            // shift tile byte
+            tile_lsb >>= 1;
+            tile_msb >>= 1;
+
+            u16 x = (7 - col) + (xtile * 8);
+            u16 y = row + (ytile * 8);
+            pt_px[table_id][y * 128 + x] = px;
+        }
+    }
+}
+
+void Ppu_DrawPT(u16 table_id, u8 pal_id, nes_color_t out[128*128])
+{
+    u64 dirty[CHR_DIRTY_WORDS];
+    Cart_ChrDirty(CHR_PT_VIEW, dirty);
+    // a table is half of the words
+    for (int w = 0; w < CHR_DIRTY_WORDS; w++) {
+        pt_dirty[w] |= dirty[w];
+    }
+    for (int w = table_id * CHR_DIRTY_WORDS / 2; w < (table_id + 1) * CHR_DIRTY_WORDS / 2; w++) {
+        u64 bits = pt_dirty[w];
+        pt_dirty[w] = 0;
+        for (int bit = 0; bits != 0; bit++, bits >>= 1) {
+            if (bits & 1) {
+                decode_tile(w * 64 + bit);
             }
         }
     }
+
+    nes_color_t colors[4];
+    for (u8 px = 0; px < 4; px++) {
+        u8 color_id = Mem_PpuRead(0x3F00 + (pal_id << 2) + px);
+        colors[px] = nes_colors[color_id & 0x3F];
+    }
+    for (int i = 0; i < 128 * 128; i++) {
+        out[i] = colors[pt_px[table_id][i]];
+    }
+}
+
+
+// *** SAVE STATES ***
+size_t Ppu_StateSize()
+{
+    return 0 PPU_STATE(STATE_SIZE);
+}
+
+u8 *Ppu_SaveState(u8 *p)
+{
+    PPU_STATE(STATE_SAVE)
+    return p;
 }
 
+const u8 *Ppu_LoadState(const u8 *p)
+{
+    PPU_STATE(STATE_LOAD)
+    // states are only taken between steps (the scheduler is loaded first)
+    dots = 3 * Sched_Now();
+    return p;
+}
 
 void Ppu_Dump()
 {
@@ -0,0 +1,287 @@
+/*
+ * rewind.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Rewind buffer. A save state is captured at the end of every frame, but
+ * only the newest one is kept in full. Every older frame is stored as the
+ * XOR of it and the frame after it, which is almost all zeros, run-length
+ * encoded into a byte ring. Stepping back applies the newest delta to the
+ * full snapshot and loads the result.
+ *
+ * Delta encoding: repeated (zero run, literal count, literal bytes), with
+ * both counts as LEB128 varints. Literals are the xor'd bytes.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <rewind.h>
+#include <state.h>
+#include <vac.h>
+
+#define FRAMES_PER_SEC 60
+// byte budget per second of history, most frames only touch a few hundred
+// bytes of state so this is plenty
+#define BYTES_PER_SEC (64*1024)
+
+typedef struct rewind_entry {
+    size_t offset;
+    size_t len;
+} rewind_entry_t;
+
+// ring of deltas, newest at (first + count - 1)
+static rewind_entry_t *entries = NULL;
+static size_t max_entries;
+static size_t first;
+static size_t count;
+
+// byte ring the deltas live in. they're laid out in the order they were
+// pushed, so at most two laps are live: the current one in [0, arena_head)
+// and the older one from arena_head on, both in increasing offsets.
+static u8 *arena = NULL;
+static size_t arena_size;
+static size_t arena_head; // where the next delta goes
+
+static size_t state_size;
+static u8 *cur = NULL;     // full snapshot of the newest frame
+static u8 *next = NULL;    // scratch for the incoming snapshot
+static u8 *scratch = NULL; // scratch for encoding
+
+// capture stats
+static u64 pushes;
+static u64 push_ns;
+static u64 push_bytes;
+
+static bool is_init = false;
+
+static u8 *put_varint(u8 *p, size_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static const u8 *get_varint(const u8 *p, size_t *v)
+{
+    size_t res = 0;
+    int shift = 0;
+    u8 b;
+    do {
+        b = *p++;
+        res |= (size_t) (b & 0x7F) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    *v = res;
+    return p;
+}
+
+// xor a and b and encode the result into out, returns encoded length
+static size_t encode_delta(const u8 *a, const u8 *b, size_t len, u8 *out)
+{
+    u8 *o = out;
+    size_t i = 0;
+    while (i < len) {
+        // zero run, a word at a time where possible
+        size_t start = i;
+        while (i + 8 <= len) {
+            u64 wa, wb;
+            memcpy(&wa, &a[i], 8);
+            memcpy(&wb, &b[i], 8);
+            if (wa != wb) {
+                break;
+            }
+            i += 8;
+        }
+        while (i < len && a[i] == b[i]) {
+            i++;
+        }
+        size_t zeros = i - start;
+
+        // literal run, ends at the first pair of matching bytes so a single
+        // equal byte doesn't cost a whole token
+        size_t lit = i;
+        while (i < len && (a[i] != b[i] || (i + 1 < len && a[i + 1] != b[i + 1]))) {
+            i++;
+        }
+        o = put_varint(o, zeros);
+        o = put_varint(o, i - lit);
+        for (size_t j = lit; j < i; j++) {
+            *o++ = a[j] ^ b[j];
+        }
+    }
+    return o - out;
+}
+
+// xor an encoded delta back into buf
+static void apply_delta(u8 *buf, const u8 *delta, size_t delta_len)
+{
+    const u8 *p = delta;
+    const u8 *end = delta + delta_len;
+    size_t i = 0;
+    while (p < end) {
+        size_t zeros, lit;
+        p = get_varint(p, &zeros);
+        p = get_varint(p, &lit);
+        i += zeros;
+        assert(i + lit <= state_size);
+        for (size_t j = 0; j < lit; j++) {
+            buf[i++] ^= *p++;
+        }
+    }
+}
+
+static void drop_oldest()
+{
+    assert(count > 0);
+    first = (first + 1) % max_entries;
+    count--;
+}
+
+// true if the oldest delta still kept starts in [off, off + len). deltas
+// placed at off are past everything newer (see arena), so the oldest one is
+// the first in the way and none start before off and reach into it.
+static bool overlaps_oldest(size_t off, size_t len)
+{
+    if (count == 0) {
+        return false;
+    }
+    rewind_entry_t *old = &entries[first];
+    return old->offset >= off && old->offset < off + len;
+}
+
+void Rewind_Init(int seconds)
+{
+    assert(seconds > 0);
+    max_entries = (size_t) seconds * FRAMES_PER_SEC;
+    arena_size = (size_t) seconds * BYTES_PER_SEC;
+
+    entries = malloc(max_entries * sizeof(rewind_entry_t));
+    arena = malloc(arena_size);
+    if (entries == NULL || arena == NULL) {
+        ERROR("Out of Host Memory!\n");
+        EXIT(1);
+    }
+    first = 0;
+    count = 0;
+    arena_head = 0;
+    pushes = 0;
+    push_ns = 0;
+    push_bytes = 0;
+    is_init = true;
+    INFO("Rewind buffer: %d seconds (%lu KB)\n", seconds, (unsigned long) arena_size / 1024);
+}
+
+// forget all history and start over from the current machine state, must be
+// called once a rom is loaded (the state size depends on the cartridge)
+void Rewind_Clear()
+{
+    if (!is_init) {
+        return;
+    }
+    first = 0;
+    count = 0;
+    arena_head = 0;
+
+    free(cur);
+    free(next);
+    free(scratch);
+    state_size = State_Size();
+    cur = malloc(state_size);
+    next = malloc(state_size);
+    // worst case: every byte a literal, plus a couple of varints per 2 bytes
+    scratch = malloc(state_size * 2 + 16);
+    if (cur == NULL || next == NULL || scratch == NULL) {
+        ERROR("Out of Host Memory!\n");
+        EXIT(1);
+    }
+    State_Save(cur);
+}
+
+// capture the current frame
+void Rewind_Push()
+{
+    if (!is_init || cur == NULL) {
+        return;
+    }
+    u64 start = Vac_NowNs();
+
+    State_Save(next);
+    size_t len = encode_delta(cur, next, state_size, scratch);
+    if (len > arena_size) {
+        // can't ever fit, history is broken from here back
+        WARNING("Rewind delta too large (%lu bytes), clearing history\n", (unsigned long) len);
+        count = 0;
+    } else {
+        // find room, wrapping to the start of the arena if needed
+        size_t off = arena_head;
+        if (off + len > arena_size) {
+            // the older lap past the head is about to become two laps ago,
+            // and it's the oldest history
+            while (count > 0 && entries[first].offset >= arena_head) {
+                drop_oldest();
+            }
+            off = 0;
+        }
+        while (overlaps_oldest(off, len) || count == max_entries) {
+            drop_oldest();
+        }
+        memcpy(&arena[off], scratch, len);
+        arena_head = off + len;
+        entries[(first + count) % max_entries] = (rewind_entry_t) {off, len};
+        count++;
+    }
+
+    // newest frame becomes the full snapshot
+    u8 *tmp = cur;
+    cur = next;
+    next = tmp;
+
+    pushes++;
+    push_bytes += len;
+    push_ns += Vac_NowNs() - start;
+}
+
+// step back one frame, returns false once out of history (the oldest frame
+// is loaded again)
+bool Rewind_Pop()
+{
+    if (!is_init || cur == NULL) {
+        return false;
+    }
+
+    bool ok = count > 0;
+    if (ok) {
+        count--;
+        rewind_entry_t *e = &entries[(first + count) % max_entries];
+        apply_delta(cur, &arena[e->offset], e->len);
+        arena_head = e->offset;
+    }
+    State_Load(cur, state_size);
+    return ok;
+}
+
+void Rewind_Free()
+{
+    if (!is_init) {
+        return;
+    }
+    if (pushes > 0) {
+        INFO("Rewind: %lu frames captured, avg %.1f us and %lu bytes per frame\n",
+            (unsigned long) pushes, push_ns / 1000.0 / pushes,
+            (unsigned long) (push_bytes / pushes));
+    }
+    free(entries);
+    free(arena);
+    free(cur);
+    free(next);
+    free(scratch);
+    entries = NULL;
+    arena = NULL;
+    cur = next = scratch = NULL;
+    is_init = false;
+}
@@ -0,0 +1,310 @@
+/*
+ * rom.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Rom images are mapped read only and shared by every console in the
+ * process that opens the same file, so the prg and chr banks sit in the page
+ * cache once no matter how many instances run them. Cart_Load references
+ * the banks in place instead of copying them.
+ *
+ * gzip and zip (the first file in the archive) roms are inflated once,
+ * straight from the compressed file's mapping into the image's own pages,
+ * and shared the same way.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <rom.h>
+
+typedef struct mapped_rom {
+    rom_image_t image; // must be first, handed out as the public handle
+    size_t map_len;    // of the mapping at image.data
+    off_t file_len;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    int refs;
+    struct mapped_rom *next;
+} mapped_rom_t;
+
+// shared by all threads
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static mapped_rom_t *roms = NULL;
+
+static bool same_file(const mapped_rom_t *rom, const struct stat *st)
+{
+    return rom->dev == st->st_dev && rom->ino == st->st_ino
+        && rom->file_len == st->st_size
+        && rom->mtime.tv_sec == st->st_mtim.tv_sec
+        && rom->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+// NULL if there's no memory for them
+static u8 *map_pages(size_t len)
+{
+    void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        ERROR("Out of Host Memory!\n");
+        return NULL;
+    }
+    return map;
+}
+
+static u32 read_le32(const u8 *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32) p[3] << 24);
+}
+
+// inflate src into fresh pages, hint is the expected size (0 if unknown).
+// a wrong hint costs one copy per doubling. false if src is truncated or
+// corrupt.
+static bool inflate_image(mapped_rom_t *rom, const u8 *src, size_t len, int window_bits, size_t hint)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t cap = ((hint > 0 ? hint : len * 2) + page - 1) / page * page;
+    u8 *out = map_pages(cap);
+    if (out == NULL) {
+        return false;
+    }
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, window_bits) != Z_OK) {
+        ERROR("Failed to start inflating rom\n");
+        munmap(out, cap);
+        return false;
+    }
+    size_t in = 0;
+    size_t done = 0;
+    int ret = Z_OK;
+    while (ret != Z_STREAM_END) {
+        if (done == cap) {
+            u8 *bigger = map_pages(cap * 2);
+            if (bigger == NULL) {
+                ret = Z_MEM_ERROR;
+                break;
+            }
+            memcpy(bigger, out, done);
+            munmap(out, cap);
+            out = bigger;
+            cap *= 2;
+        }
+        // z_stream counts are 32 bit, feed it in pieces
+        zs.next_in = (u8 *) src + in;
+        zs.avail_in = len - in < UINT_MAX ? len - in : UINT_MAX;
+        zs.next_out = out + done;
+        zs.avail_out = cap - done < UINT_MAX ? cap - done : UINT_MAX;
+        size_t avail_in = zs.avail_in;
+        size_t avail_out = zs.avail_out;
+        ret = inflate(&zs, Z_NO_FLUSH);
+        in += avail_in - zs.avail_in;
+        done += avail_out - zs.avail_out;
+        if (ret != Z_OK && ret != Z_STREAM_END && !(ret == Z_BUF_ERROR && done == cap)) {
+            ERROR("Compressed rom is %s\n", ret == Z_BUF_ERROR ? "truncated" : "corrupt");
+            break;
+        }
+    }
+    inflateEnd(&zs);
+    if (ret != Z_STREAM_END) {
+        munmap(out, cap);
+        return false;
+    }
+
+    mprotect(out, cap, PROT_READ);
+    rom->image.data = out;
+    rom->image.len = done;
+    rom->map_len = cap;
+    return true;
+}
+
+// a zip's first file, stored or deflated. false if it's neither or the zip
+// is broken.
+static bool unzip_image(mapped_rom_t *rom, const u8 *src, size_t len)
+{
+    const size_t hdr_len = 30;
+    if (len < hdr_len) {
+        ERROR("Zip rom is truncated\n");
+        return false;
+    }
+    u16 flags = src[6] | (src[7] << 8);
+    u16 method = src[8] | (src[9] << 8);
+    u32 size = read_le32(src + 22);
+    size_t data = hdr_len + (src[26] | (src[27] << 8)) + (src[28] | (src[29] << 8));
+    // bit 3: the sizes come after the data
+    bool sized = !(flags & 0x8);
+    if (data > len || (sized && method == 0 && size > len - data)) {
+        ERROR("Zip rom is truncated\n");
+        return false;
+    }
+    if (method == 8) {
+        return inflate_image(rom, src + data, len - data, -MAX_WBITS, sized ? size : 0);
+    }
+    if (method == 0 && sized) {
+        u8 *out = map_pages(size > 0 ? size : 1);
+        if (out == NULL) {
+            return false;
+        }
+        memcpy(out, src + data, size);
+        mprotect(out, size > 0 ? size : 1, PROT_READ);
+        rom->image.data = out;
+        rom->image.len = size;
+        rom->map_len = size > 0 ? size : 1;
+        return true;
+    }
+    ERROR("Unsupported zip compression (method %u)\n", method);
+    return false;
+}
+
+// fill in rom's image from a gzip or zip file's bytes. a plain rom leaves
+// the image NULL, it's used as is. false if the archive is broken.
+static bool decompress(mapped_rom_t *rom, const u8 *src, size_t len)
+{
+    if (len >= 18 && src[0] == 0x1F && src[1] == 0x8B) {
+        // the trailer has the size (mod 4 GB)
+        return inflate_image(rom, src, len, MAX_WBITS + 16, read_le32(src + len - 4));
+    }
+    if (len >= 4 && memcmp(src, "PK\x03\x04", 4) == 0) {
+        return unzip_image(rom, src, len);
+    }
+    return true;
+}
+
+// a new image of an open rom file, NULL if it can't be mapped or inflated
+static mapped_rom_t *map_file(int fd, const struct stat *st, const char *path)
+{
+    void *data = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        ERROR("Failed to map %s\n", path);
+        return NULL;
+    }
+    mapped_rom_t *rom = calloc(1, sizeof(mapped_rom_t));
+    if (rom == NULL) {
+        ERROR("Out of Host Memory!\n");
+        munmap(data, st->st_size);
+        return NULL;
+    }
+    if (!decompress(rom, data, st->st_size)) {
+        free(rom);
+        munmap(data, st->st_size);
+        return NULL;
+    }
+    if (rom->image.data != NULL) {
+        munmap(data, st->st_size);
+    } else {
+        rom->image.data = data;
+        rom->image.len = st->st_size;
+        rom->map_len = st->st_size;
+    }
+    rom->file_len = st->st_size;
+    rom->dev = st->st_dev;
+    rom->ino = st->st_ino;
+    rom->mtime = st->st_mtim;
+    rom->refs = 1;
+    return rom;
+}
+
+// map a rom file, or share the mapping if it's already open. compressed
+// roms are inflated. NULL if it can't be read or doesn't inflate.
+const rom_image_t *Rom_Open(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        ERROR("Failed to open %s\n", path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ERROR("Failed to read %s\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&lock);
+    mapped_rom_t *rom;
+    for (rom = roms; rom != NULL; rom = rom->next) {
+        if (same_file(rom, &st)) {
+            rom->refs++;
+            break;
+        }
+    }
+    if (rom == NULL) {
+        rom = map_file(fd, &st, path);
+        if (rom != NULL) {
+            rom->next = roms;
+            roms = rom;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+
+    close(fd);
+    return rom != NULL ? &rom->image : NULL;
+}
+
+// a private image of a rom in memory (inflated if it's compressed), for roms
+// that don't come from a file. never shared. NULL if it doesn't inflate.
+const rom_image_t *Rom_FromMemory(const u8 *data, size_t len)
+{
+    mapped_rom_t *rom = calloc(1, sizeof(mapped_rom_t));
+    if (rom == NULL) {
+        ERROR("Out of Host Memory!\n");
+        return NULL;
+    }
+    if (!decompress(rom, data, len)) {
+        free(rom);
+        return NULL;
+    }
+    if (rom->image.data == NULL) {
+        u8 *copy = map_pages(len > 0 ? len : 1);
+        if (copy == NULL) {
+            free(rom);
+            return NULL;
+        }
+        memcpy(copy, data, len);
+        rom->image.data = copy;
+        rom->image.len = len;
+        rom->map_len = len > 0 ? len : 1;
+    }
+    rom->file_len = -1; // no file matches
+    rom->refs = 1;
+
+    pthread_mutex_lock(&lock);
+    rom->next = roms;
+    roms = rom;
+    pthread_mutex_unlock(&lock);
+    return &rom->image;
+}
+
+// drop a reference, the mapping goes away with the last one
+void Rom_Close(const rom_image_t *image)
+{
+    if (image == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    mapped_rom_t **link = &roms;
+    while (*link != NULL && &(*link)->image != image) {
+        link = &(*link)->next;
+    }
+    mapped_rom_t *rom = *link;
+    assert(rom != NULL);
+    if (--rom->refs == 0) {
+        *link = rom->next;
+        munmap((void *) rom->image.data, rom->map_len);
+        free(rom);
+    }
+    pthread_mutex_unlock(&lock);
+}
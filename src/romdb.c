@@ -0,0 +1,161 @@
+/*
+ * romdb.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Rom database. Headers are often wrong (old dumps, hand edited, DiskDude!),
+ * so Cart_Load looks the prg and chr data's crc32 up here and believes the
+ * database over the header.
+ *
+ * The index file is a small header and the entries sorted by crc, mapped
+ * read only and binary searched in place: opening it is an mmap whatever
+ * its size and a lookup touches log2(n) entries. nes-romdb builds it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <romdb.h>
+
+#define ROMDB_MAGIC "NESROMDB"
+#define ROMDB_VERSION 1
+
+typedef struct romdb_file_header {
+    char magic[8];
+    u32 version;
+    u32 count;
+} romdb_file_header_t;
+
+struct romdb {
+    const u8 *map;
+    size_t len;
+    const romdb_entry_t *entries;
+    size_t count;
+};
+
+// NULL if path isn't a rom database this version reads
+romdb_t *Romdb_Open(const char *path)
+{
+    assert(sizeof(romdb_entry_t) == 12 && sizeof(romdb_file_header_t) == 16);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        ERROR("Failed to open %s\n", path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("fstat");
+        ERROR("Failed to read %s\n", path);
+        close(fd);
+        return NULL;
+    }
+    if ((size_t) st.st_size < sizeof(romdb_file_header_t)) {
+        ERROR("%s is not a rom database\n", path);
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        ERROR("Failed to map %s\n", path);
+        return NULL;
+    }
+
+    const romdb_file_header_t *hdr = map;
+    if (memcmp(hdr->magic, ROMDB_MAGIC, sizeof(hdr->magic)) != 0 || hdr->version != ROMDB_VERSION
+            || sizeof(*hdr) + (size_t) hdr->count * sizeof(romdb_entry_t) != (size_t) st.st_size) {
+        ERROR("%s is not a version %d rom database\n", path, ROMDB_VERSION);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    romdb_t *db = malloc(sizeof(romdb_t));
+    if (db == NULL) {
+        ERROR("Out of Host Memory!\n");
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    db->map = map;
+    db->len = st.st_size;
+    db->entries = (const romdb_entry_t *) (db->map + sizeof(*hdr));
+    db->count = hdr->count;
+    return db;
+}
+
+void Romdb_Close(romdb_t *db)
+{
+    if (db == NULL) {
+        return;
+    }
+    munmap((void *) db->map, db->len);
+    free(db);
+}
+
+size_t Romdb_Count(const romdb_t *db)
+{
+    return db->count;
+}
+
+// NULL if the cart isn't in the database
+const romdb_entry_t *Romdb_Find(const romdb_t *db, u32 crc)
+{
+    size_t lo = 0;
+    size_t hi = db->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (db->entries[mid].crc < crc) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < db->count && db->entries[lo].crc == crc) {
+        return &db->entries[lo];
+    }
+    return NULL;
+}
+
+static int cmp_entry(const void *a, const void *b)
+{
+    u32 ca = ((const romdb_entry_t *) a)->crc;
+    u32 cb = ((const romdb_entry_t *) b)->crc;
+    return ca < cb ? -1 : ca > cb;
+}
+
+// sorts entries and writes them as an index, false (with a message) on
+// failure or duplicate crcs
+bool Romdb_Write(const char *path, romdb_entry_t *entries, size_t count)
+{
+    qsort(entries, count, sizeof(romdb_entry_t), cmp_entry);
+    for (size_t i = 1; i < count; i++) {
+        if (entries[i].crc == entries[i - 1].crc) {
+            ERROR("Duplicate crc %08X\n", entries[i].crc);
+            return false;
+        }
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        perror("fopen");
+        ERROR("Failed to open %s\n", path);
+        return false;
+    }
+    romdb_file_header_t hdr = {0};
+    memcpy(hdr.magic, ROMDB_MAGIC, sizeof(hdr.magic));
+    hdr.version = ROMDB_VERSION;
+    hdr.count = count;
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1
+        && fwrite(entries, sizeof(romdb_entry_t), count, f) == count;
+    ok = fclose(f) == 0 && ok;
+    if (!ok) {
+        ERROR("Failed to write %s\n", path);
+    }
+    return ok;
+}
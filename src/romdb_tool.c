@@ -0,0 +1,178 @@
+/*
+ * romdb_tool.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * nes-romdb: builds the index the emulator's rom database maps (--romdb)
+ * from a text list, one cart per line:
+ *
+ *   <crc32> <mapper>[.<submapper>] <h|v|4> <prg-ram bytes> <chr-ram bytes> [battery]
+ *
+ * crc32 is of the prg and chr data (Ines_DataCrc), ram sizes are 0 or a
+ * power of two from 128. Lines starting with # are comments. -l prints the
+ * line for roms as their headers describe them, to start a list from.
+ *
+ * usage: nes-romdb <list> <index>
+ *        nes-romdb -l <rom>...
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <utils.h>
+#include <cart.h>
+#include <rom.h>
+#include <romdb.h>
+#include <ines.h>
+
+static void usage()
+{
+    fprintf(stderr, "usage: nes-romdb <list> <index>\n");
+    fprintf(stderr, "       nes-romdb -l <rom>...\n");
+}
+
+// ram size in bytes to the index's shift count, false if it has none
+static bool ram_shift(unsigned long size, u8 *shift)
+{
+    if (size == 0) {
+        *shift = 0;
+        return true;
+    }
+    for (u8 n = 1; n < 16; n++) {
+        if (64ul << n == size) {
+            *shift = n;
+            return true;
+        }
+    }
+    return false;
+}
+
+// false if path isn't a rom
+static bool list_rom(const char *path)
+{
+    const rom_image_t *image = Rom_Open(path);
+    if (image == NULL) {
+        return false;
+    }
+    ines_header_t h;
+    if (!Ines_ReadHeader(image->data, image->len, &h)) {
+        ERROR("%s is not a rom\n", path);
+        Rom_Close(image);
+        return false;
+    }
+    u32 crc = Ines_DataCrc(&h, image->data, image->len);
+    char mirror = h.mirror_mode == MIR_4SCRN ? '4' : h.mirror_mode == MIR_VERT ? 'v' : 'h';
+    unsigned long prgram = h.prgnvram_size != 0 ? h.prgnvram_size : h.prgram_size;
+    unsigned long chrram = h.chrram_size + h.chrnvram_size;
+    printf("%08X %u.%u %c %lu %lu%s # %s\n", crc, h.mapper_num, h.submapper, mirror, prgram,
+        chrram, h.battery ? " battery" : "", path);
+    Rom_Close(image);
+    return true;
+}
+
+// parse one list line, false if it's malformed
+static bool parse_line(char *line, romdb_entry_t *e)
+{
+    unsigned long crc, mapper, submapper = 0, prgram, chrram;
+    char mapper_str[16], mirror[4], battery[16] = "";
+    int n = sscanf(line, "%lx %15s %3s %lu %lu %15s", &crc, mapper_str, mirror, &prgram,
+        &chrram, battery);
+    if (n < 5) {
+        return false;
+    }
+    char *dot = strchr(mapper_str, '.');
+    if (dot != NULL) {
+        *dot = '\0';
+        submapper = strtoul(dot + 1, NULL, 10);
+    }
+    mapper = strtoul(mapper_str, NULL, 10);
+
+    memset(e, 0, sizeof(*e));
+    e->crc = crc;
+    e->mapper = mapper;
+    e->submapper = submapper;
+    switch (mirror[0]) {
+    case 'h':
+        e->mirror = MIR_HORZ;
+        break;
+    case 'v':
+        e->mirror = MIR_VERT;
+        break;
+    case '4':
+        e->mirror = MIR_4SCRN;
+        break;
+    default:
+        return false;
+    }
+    if (n == 6 && battery[0] != '#') {
+        if (strcmp(battery, "battery") != 0) {
+            return false;
+        }
+        e->flags |= ROMDB_BATTERY;
+    }
+    return mapper < 4096 && submapper < 16 && ram_shift(prgram, &e->prgram)
+        && ram_shift(chrram, &e->chrram);
+}
+
+static int build(const char *list_path, const char *index_path)
+{
+    FILE *list = fopen(list_path, "r");
+    if (list == NULL) {
+        perror("fopen");
+        ERROR("Failed to open %s\n", list_path);
+        return 1;
+    }
+    size_t count = 0;
+    size_t cap = 1024;
+    romdb_entry_t *entries = malloc(cap * sizeof(romdb_entry_t));
+    char line[256];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), list) != NULL) {
+        lineno++;
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0') {
+            continue;
+        }
+        if (count == cap) {
+            cap *= 2;
+            entries = realloc(entries, cap * sizeof(romdb_entry_t));
+        }
+        if (entries == NULL) {
+            ERROR("Out of Host Memory!\n");
+            return 1;
+        }
+        if (!parse_line(p, &entries[count])) {
+            ERROR("%s:%d: bad line\n", list_path, lineno);
+            return 1;
+        }
+        count++;
+    }
+    fclose(list);
+
+    if (!Romdb_Write(index_path, entries, count)) {
+        return 1;
+    }
+    printf("%s: %lu roms\n", index_path, (unsigned long) count);
+    free(entries);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 3 && strcmp(argv[1], "-l") == 0) {
+        // the rest are still listed when one isn't a rom
+        int ret = 0;
+        for (int i = 2; i < argc; i++) {
+            if (!list_rom(argv[i])) {
+                ret = 1;
+            }
+        }
+        return ret;
+    }
+    if (argc != 3) {
+        usage();
+        return 1;
+    }
+    return build(argv[1], argv[2]);
+}
@@ -0,0 +1,122 @@
+/*
+ * sav.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Battery backed ram lives in a shared mapping of the .sav file, so the
+ * game's writes land in the page cache as they happen with no copying and
+ * no syscalls. The file is up to date even if the process dies, flushing
+ * (msync) only pushes it on to the disk.
+ */
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <sav.h>
+
+typedef struct open_sav {
+    sav_file_t sav; // must be first, handed out as the public handle
+    struct open_sav *next;
+} open_sav_t;
+
+// shared by all threads so any of them can sync on exit
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static open_sav_t *savs = NULL;
+
+// map len bytes of a save file, a new (or short) file is padded with zeros.
+// NULL if the file can't be opened or mapped (read-only directory, ...).
+sav_file_t *Sav_Open(const char *path, size_t len)
+{
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror("open");
+        ERROR("Failed to open %s\n", path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("fstat");
+        ERROR("Failed to read %s\n", path);
+        close(fd);
+        return NULL;
+    }
+    if ((size_t) st.st_size < len && ftruncate(fd, len) != 0) {
+        perror("ftruncate");
+        ERROR("Failed to grow %s to %lu bytes\n", path, (unsigned long) len);
+        close(fd);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        ERROR("Failed to map %s\n", path);
+        close(fd);
+        return NULL;
+    }
+    open_sav_t *open_sav = malloc(sizeof(open_sav_t));
+    if (open_sav == NULL) {
+        ERROR("Out of Host Memory!\n");
+        munmap(data, len);
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+    open_sav->sav.data = data;
+    open_sav->sav.len = len;
+
+    pthread_mutex_lock(&lock);
+    open_sav->next = savs;
+    savs = open_sav;
+    pthread_mutex_unlock(&lock);
+
+    INFO("Battery ram saved to %s\n", path);
+    return &open_sav->sav;
+}
+
+// write back and unmap
+void Sav_Close(sav_file_t *sav)
+{
+    if (sav == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    open_sav_t **link = &savs;
+    while (*link != NULL && &(*link)->sav != sav) {
+        link = &(*link)->next;
+    }
+    open_sav_t *open_sav = *link;
+    assert(open_sav != NULL);
+    *link = open_sav->next;
+    pthread_mutex_unlock(&lock);
+
+    msync(sav->data, sav->len, MS_SYNC);
+    munmap(sav->data, sav->len);
+    free(open_sav);
+}
+
+// start writing the file back without waiting on it
+void Sav_Flush(sav_file_t *sav)
+{
+    msync(sav->data, sav->len, MS_ASYNC);
+}
+
+// wait for every open save to reach the disk, safe to call from any thread
+// (including the exit handler). if the list is busy we give up, the page
+// cache has the data either way.
+void Sav_SyncAll()
+{
+    if (pthread_mutex_trylock(&lock) != 0) {
+        return;
+    }
+    for (open_sav_t *open_sav = savs; open_sav != NULL; open_sav = open_sav->next) {
+        msync(open_sav->sav.data, open_sav->sav.len, MS_SYNC);
+    }
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,134 @@
+/*
+ * scheduler.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Event scheduler for the NES. Hardware which would otherwise need to be
+ * checked every cycle (frame counter, dmc, ...) registers a handler and a
+ * timestamp here instead. The cpu advances the clock after every instruction
+ * and the handlers only run once their timestamp has been reached.
+ */
+
+#include <scheduler.h>
+#include <state.h>
+
+#define CHECK_INIT if(!is_init){ERROR("Not Initialized!\n"); EXIT(1);}
+
+static _Thread_local u64 now;
+static _Thread_local u64 next;
+static _Thread_local u64 when[EV_COUNT];
+static _Thread_local sched_handler_t handlers[EV_COUNT];
+
+// handlers are wired up at init, only the timestamps are state
+#define SCHED_STATE(X) X(now) X(when)
+
+static void find_next()
+{
+    next = SCHED_NEVER;
+    for (int ev = 0; ev < EV_COUNT; ev++) {
+        if (when[ev] < next) {
+            next = when[ev];
+        }
+    }
+}
+
+static _Thread_local bool is_init = false;
+void Sched_Init()
+{
+    for (int ev = 0; ev < EV_COUNT; ev++) {
+        handlers[ev] = NULL;
+    }
+    is_init = true;
+    Sched_Reset();
+}
+
+void Sched_Reset()
+{
+#ifdef DEBUG
+    CHECK_INIT;
+#endif
+    now = 0;
+    for (int ev = 0; ev < EV_COUNT; ev++) {
+        when[ev] = SCHED_NEVER;
+    }
+    next = SCHED_NEVER;
+}
+
+void Sched_Register(sched_event_t ev, sched_handler_t handler)
+{
+    assert(ev < EV_COUNT);
+    handlers[ev] = handler;
+}
+
+void Sched_Add(sched_event_t ev, u64 at)
+{
+#ifdef DEBUG
+    CHECK_INIT;
+#endif
+    assert(ev < EV_COUNT);
+    assert(handlers[ev] != NULL);
+    u64 old = when[ev];
+    when[ev] = at;
+    if (at < next) {
+        next = at;
+    } else if (old == next) {
+        // event was moved later, it might not be the earliest anymore
+        find_next();
+    }
+}
+
+void Sched_Cancel(sched_event_t ev)
+{
+    assert(ev < EV_COUNT);
+    if (when[ev] == SCHED_NEVER) {
+        return;
+    }
+    bool was_next = when[ev] == next;
+    when[ev] = SCHED_NEVER;
+    if (was_next) {
+        find_next();
+    }
+}
+
+void Sched_Advance(int cycles)
+{
+    now += cycles;
+    // fire everything which came due, earliest first
+    while (next <= now) {
+        int ev = 0;
+        for (int i = 1; i < EV_COUNT; i++) {
+            if (when[i] < when[ev]) {
+                ev = i;
+            }
+        }
+        u64 at = when[ev];
+        when[ev] = SCHED_NEVER;
+        find_next();
+        handlers[ev](at);
+    }
+}
+
+u64 Sched_Now()
+{
+    return now;
+}
+
+// *** SAVE STATES ***
+size_t Sched_StateSize()
+{
+    return 0 SCHED_STATE(STATE_SIZE);
+}
+
+u8 *Sched_SaveState(u8 *p)
+{
+    SCHED_STATE(STATE_SAVE)
+    return p;
+}
+
+const u8 *Sched_LoadState(const u8 *p)
+{
+    SCHED_STATE(STATE_LOAD)
+    find_next();
+    return p;
+}
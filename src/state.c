@@ -0,0 +1,145 @@
+/*
+ * state.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Save states. Each module copies its own state in and out of one flat
+ * versioned blob, which is nothing but a handful of memcpys (tens of KB
+ * total) so saving and loading are cheap enough to do every frame.
+ *
+ * Layout: header | sched | cpu | ppu | apu | mem | cart (+ mapper)
+ * The blob is only meant to be loaded by the same build on the same rom.
+ */
+
+#include <stdlib.h>
+
+#include <state.h>
+#include <scheduler.h>
+#include <cpu.h>
+#include <ppu.h>
+#include <apu.h>
+#include <mem.h>
+#include <cart.h>
+
+#define STATE_MAGIC 0x5354534E // "NSTS"
+
+typedef struct state_header {
+    u32 magic;
+    u32 version;
+    u32 size;     // size of the whole blob including this header
+    u32 reserved;
+} state_header_t;
+
+size_t State_Size()
+{
+    return sizeof(state_header_t)
+        + Sched_StateSize()
+        + Cpu_StateSize()
+        + Ppu_StateSize()
+        + Apu_StateSize()
+        + Mem_StateSize()
+        + Cart_StateSize();
+}
+
+// buf must hold at least State_Size() bytes
+void State_Save(u8 *buf)
+{
+    state_header_t hdr = {STATE_MAGIC, STATE_VERSION, State_Size(), 0};
+    memcpy(buf, &hdr, sizeof(hdr));
+
+    u8 *p = buf + sizeof(hdr);
+    p = Sched_SaveState(p);
+    p = Cpu_SaveState(p);
+    p = Ppu_SaveState(p);
+    p = Apu_SaveState(p);
+    p = Mem_SaveState(p);
+    p = Cart_SaveState(p);
+    assert((size_t) (p - buf) == hdr.size);
+}
+
+bool State_Load(const u8 *buf, size_t len)
+{
+    state_header_t hdr;
+    if (len < sizeof(hdr)) {
+        WARNING("Save state too small (%lu bytes)\n", (unsigned long) len);
+        return false;
+    }
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (hdr.magic != STATE_MAGIC) {
+        WARNING("Not a save state\n");
+        return false;
+    }
+    if (hdr.version != STATE_VERSION) {
+        WARNING("Save state version %u not supported (expected %u)\n", hdr.version, STATE_VERSION);
+        return false;
+    }
+    if (hdr.size != len || hdr.size != State_Size()) {
+        WARNING("Save state size mismatch (was it made with a different rom?)\n");
+        return false;
+    }
+
+    const u8 *p = buf + sizeof(hdr);
+    p = Sched_LoadState(p);
+    p = Cpu_LoadState(p);
+    p = Ppu_LoadState(p);
+    p = Apu_LoadState(p);
+    p = Mem_LoadState(p);
+    p = Cart_LoadState(p);
+    assert((size_t) (p - buf) == hdr.size);
+    return true;
+}
+
+bool State_SaveFile(const char *path)
+{
+    size_t size = State_Size();
+    u8 *buf = malloc(size);
+    if (buf == NULL) {
+        ERROR("Out of Host Memory!\n");
+        EXIT(1);
+    }
+    State_Save(buf);
+
+    FILE *ofile = fopen(path, "wb");
+    if (ofile == NULL) {
+        perror("fopen");
+        WARNING("Failed to save state to %s\n", path);
+        free(buf);
+        return false;
+    }
+    bool ok = fwrite(buf, 1, size, ofile) == size;
+    fclose(ofile);
+    free(buf);
+    if (!ok) {
+        WARNING("Failed to write state to %s\n", path);
+    }
+    return ok;
+}
+
+bool State_LoadFile(const char *path)
+{
+    FILE *ifile = fopen(path, "rb");
+    if (ifile == NULL) {
+        perror("fopen");
+        WARNING("Failed to load state from %s\n", path);
+        return false;
+    }
+    fseek(ifile, 0, SEEK_END);
+    long len = ftell(ifile);
+    fseek(ifile, 0, SEEK_SET);
+    if (len <= 0) {
+        WARNING("Failed to load state from %s\n", path);
+        fclose(ifile);
+        return false;
+    }
+
+    u8 *buf = malloc(len);
+    if (buf == NULL) {
+        ERROR("Out of Host Memory!\n");
+        EXIT(1);
+    }
+    bool ok = fread(buf, 1, len, ifile) == (size_t) len && State_Load(buf, len);
+    fclose(ifile);
+    free(buf);
+    return ok;
+}
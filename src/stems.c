@@ -0,0 +1,194 @@
+/*
+ * stems.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Captures every apu channel plus the final mix to disk. Paths ending in
+ * ".wav" get a multi-channel 32-bit float WAV file, everything else is written
+ * as raw interleaved floats.
+ *
+ * The apu pushes frames into a bounded single-producer/single-consumer ring
+ * and a background thread does all of the file io, so the emulation never
+ * waits on the disk. If the writer falls behind, frames are dropped and
+ * counted rather than blocking.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <stems.h>
+
+// number of frames the ring holds (must be a power of 2). ~6 seconds of
+// audio, which is plenty of slack for the writer even when running headless
+// at many times real-time.
+#define RING_FRAMES (1 << 18)
+#define RING_MASK (RING_FRAMES - 1)
+
+#define WAV_HEADER_SIZE 44
+
+static float (*ring)[STEM_CHANNELS] = NULL;
+static atomic_size_t head; // next frame to write (owned by producer)
+static atomic_size_t tail; // next frame to read (owned by writer)
+static atomic_bool running;
+static u64 dropped;
+
+static FILE *ofile = NULL;
+static bool is_wav;
+static int rate;
+static u64 data_bytes;
+static pthread_t writer;
+
+static void put_u16(u8 *p, u16 v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put_u32(u8 *p, u32 v)
+{
+    put_u16(p, v & 0xFFFF);
+    put_u16(p + 2, v >> 16);
+}
+
+static void write_wav_header()
+{
+    u8 hdr[WAV_HEADER_SIZE];
+    u16 block_align = STEM_CHANNELS * sizeof(float);
+    u32 data_size = data_bytes > 0xFFFFFFFF - 36 ? 0xFFFFFFFF - 36 : (u32) data_bytes;
+
+    memcpy(&hdr[0], "RIFF", 4);
+    put_u32(&hdr[4], 36 + data_size);
+    memcpy(&hdr[8], "WAVE", 4);
+    memcpy(&hdr[12], "fmt ", 4);
+    put_u32(&hdr[16], 16);
+    put_u16(&hdr[20], 3); // IEEE float
+    put_u16(&hdr[22], STEM_CHANNELS);
+    put_u32(&hdr[24], rate);
+    put_u32(&hdr[28], rate * block_align);
+    put_u16(&hdr[32], block_align);
+    put_u16(&hdr[34], 32);
+    memcpy(&hdr[36], "data", 4);
+    put_u32(&hdr[40], data_size);
+
+    fwrite(hdr, 1, WAV_HEADER_SIZE, ofile);
+}
+
+// write out everything currently in the ring, returns number of frames written
+static size_t drain()
+{
+    size_t t = atomic_load_explicit(&tail, memory_order_relaxed);
+    size_t h = atomic_load_explicit(&head, memory_order_acquire);
+    size_t avail = h - t;
+    size_t written = 0;
+    while (avail > 0) {
+        // write up to the end of the ring in one go
+        size_t start = t & RING_MASK;
+        size_t n = RING_FRAMES - start;
+        if (n > avail) {
+            n = avail;
+        }
+        fwrite(ring[start], sizeof(ring[0]), n, ofile);
+        data_bytes += n * sizeof(ring[0]);
+        t += n;
+        avail -= n;
+        written += n;
+        atomic_store_explicit(&tail, t, memory_order_release);
+    }
+    return written;
+}
+
+static void *writer_main(void *arg)
+{
+    (void) arg;
+    const struct timespec nap = {0, 2 * 1000 * 1000};
+    while (atomic_load_explicit(&running, memory_order_acquire)) {
+        if (drain() == 0) {
+            nanosleep(&nap, NULL);
+        }
+    }
+    // pick up anything pushed before we were told to stop
+    drain();
+    return NULL;
+}
+
+void Stems_Open(const char *path, int sample_rate)
+{
+    assert(ofile == NULL);
+
+    ofile = fopen(path, "wb");
+    if (ofile == NULL) {
+        perror("fopen");
+        ERROR("Failed to open %s\n", path);
+        EXIT(1);
+    }
+
+    ring = malloc(sizeof(ring[0]) * RING_FRAMES);
+    if (ring == NULL) {
+        ERROR("Out of Host Memory!\n");
+        EXIT(1);
+    }
+
+    size_t len = strlen(path);
+    is_wav = len >= 4 && strcmp(&path[len - 4], ".wav") == 0;
+    rate = sample_rate;
+    data_bytes = 0;
+    dropped = 0;
+    atomic_store(&head, 0);
+    atomic_store(&tail, 0);
+    if (is_wav) {
+        // sizes get filled in on close
+        write_wav_header();
+    }
+
+    atomic_store(&running, true);
+    int rc = pthread_create(&writer, NULL, writer_main, NULL);
+    if (rc != 0) {
+        ERROR("Failed to start stem writer thread\n");
+        EXIT(1);
+    }
+    INFO("Capturing audio stems to %s\n", path);
+}
+
+void Stems_Push(const float frame[STEM_CHANNELS])
+{
+    if (ring == NULL) {
+        return;
+    }
+
+    size_t h = atomic_load_explicit(&head, memory_order_relaxed);
+    size_t t = atomic_load_explicit(&tail, memory_order_acquire);
+    if (h - t >= RING_FRAMES) {
+        // writer can't keep up, never stall the emulation for it
+        dropped++;
+        return;
+    }
+    memcpy(ring[h & RING_MASK], frame, sizeof(ring[0]));
+    atomic_store_explicit(&head, h + 1, memory_order_release);
+}
+
+void Stems_Close()
+{
+    if (ofile == NULL) {
+        return;
+    }
+
+    atomic_store(&running, false);
+    pthread_join(writer, NULL);
+
+    if (is_wav) {
+        fseek(ofile, 0, SEEK_SET);
+        write_wav_header();
+    }
+    fclose(ofile);
+    ofile = NULL;
+    free(ring);
+    ring = NULL;
+
+    if (dropped > 0) {
+        WARNING("Stem writer fell behind, %lu frames dropped\n", (unsigned long) dropped);
+    }
+}
@@ -8,6 +8,8 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include <utils.h>
 
 #define LMAP_SIZE 4
@@ -85,6 +87,137 @@ unsigned char Utils_FlipByte(unsigned char b) {
    return b;
 }
 
+// XXH64 (https://github.com/Cyan4973/xxHash), used for rom and frame hashes.
+// Reads are little-endian host order, which is all we run on.
+#define XXH_P1 0x9E3779B185EBCA87ULL
+#define XXH_P2 0xC2B2AE3D27D4EB4FULL
+#define XXH_P3 0x165667B19E3779F9ULL
+#define XXH_P4 0x85EBCA77C2B2AE63ULL
+#define XXH_P5 0x27D4EB2F165667C5ULL
+
+static inline u64 rotl64(u64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline u64 xxh_round(u64 acc, u64 in)
+{
+    acc += in * XXH_P2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_P1;
+}
+
+static inline u64 xxh_merge(u64 acc, u64 val)
+{
+    acc ^= xxh_round(0, val);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+u64 Utils_Hash64(const void *data, size_t len, u64 seed)
+{
+    const u8 *p = data;
+    const u8 *end = p + len;
+    u64 h;
+
+    if (len >= 32) {
+        u64 v1 = seed + XXH_P1 + XXH_P2;
+        u64 v2 = seed + XXH_P2;
+        u64 v3 = seed;
+        u64 v4 = seed - XXH_P1;
+        const u8 *limit = end - 32;
+        do {
+            u64 w[4];
+            memcpy(w, p, 32);
+            v1 = xxh_round(v1, w[0]);
+            v2 = xxh_round(v2, w[1]);
+            v3 = xxh_round(v3, w[2]);
+            v4 = xxh_round(v4, w[3]);
+            p += 32;
+        } while (p <= limit);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    } else {
+        h = seed + XXH_P5;
+    }
+    h += len;
+
+    while (p + 8 <= end) {
+        u64 w;
+        memcpy(&w, p, 8);
+        h ^= xxh_round(0, w);
+        h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        u32 w;
+        memcpy(&w, p, 4);
+        h ^= (u64) w * XXH_P1;
+        h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p++) * XXH_P5;
+        h = rotl64(h, 11) * XXH_P1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+// CRC-32 (the zip/No-Intro one, reflected 0xEDB88320), slicing by 8: eight
+// table lookups per 8 bytes instead of one per byte. the tables are built
+// once per process. assumes a little endian host.
+static u32 crc_tables[8][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init()
+{
+    for (u32 i = 0; i < 256; i++) {
+        u32 c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : c >> 1;
+        }
+        crc_tables[0][i] = c;
+    }
+    for (u32 i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            u32 prev = crc_tables[t - 1][i];
+            crc_tables[t][i] = (prev >> 8) ^ crc_tables[0][prev & 0xFF];
+        }
+    }
+}
+
+// pass 0 to start, or a previous result to continue it
+u32 Utils_Crc32(const void *data, size_t len, u32 crc)
+{
+    pthread_once(&crc_once, crc_init);
+    const u8 *p = data;
+    crc = ~crc;
+    while (len >= 8) {
+        u32 lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = crc_tables[7][lo & 0xFF] ^ crc_tables[6][(lo >> 8) & 0xFF]
+            ^ crc_tables[5][(lo >> 16) & 0xFF] ^ crc_tables[4][lo >> 24]
+            ^ crc_tables[3][hi & 0xFF] ^ crc_tables[2][(hi >> 8) & 0xFF]
+            ^ crc_tables[1][(hi >> 16) & 0xFF] ^ crc_tables[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = (crc >> 8) ^ crc_tables[0][(crc ^ *p++) & 0xFF];
+    }
+    return ~crc;
+}
+
 static char *op_str[] =
 {
     // MSD 0
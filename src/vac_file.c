@@ -0,0 +1,72 @@
+/*
+ * vac_file.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * File backend for the Video, Audio, and Controllers wrapper. Runs headless
+ * like the null backend (same input script and virtual clock) but writes
+ * every published frame to <prefix>.rgb as raw 256x240 RGB24 and all audio
+ * to <prefix>.f32 as raw mono 32-bit floats at 44.1 kHz.
+ *
+ * e.g. ffmpeg -f rawvideo -pixel_format rgb24 -video_size 256x240
+ *             -framerate 60.0988 -i out.rgb out.mp4
+ */
+
+#include <stdio.h>
+
+#include <vac.h>
+#include <vac_backends.h>
+
+static FILE *vfile = NULL;
+static FILE *afile = NULL;
+static u64 frames_written = 0;
+
+static FILE *open_out(const char *prefix, const char *ext)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s%s", prefix, ext);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        perror("fopen");
+        ERROR("Failed to open %s\n", path);
+        EXIT(1);
+    }
+    return file;
+}
+
+void VacFile_Init(const vac_config_t *cfg)
+{
+    assert(cfg->out_prefix != NULL);
+    VacNull_Init(cfg);
+    vfile = open_out(cfg->out_prefix, ".rgb");
+    afile = open_out(cfg->out_prefix, ".f32");
+    INFO("Writing frames to %s.rgb and audio to %s.f32\n", cfg->out_prefix, cfg->out_prefix);
+}
+
+void VacFile_Free()
+{
+    if (vfile != NULL) {
+        fclose(vfile);
+        vfile = NULL;
+        INFO("Wrote %lu frames\n", (unsigned long) frames_written);
+    }
+    if (afile != NULL) {
+        fclose(afile);
+        afile = NULL;
+    }
+    VacNull_Free();
+}
+
+void VacFile_PublishFrame(const nes_color_t *frame, u64 hash)
+{
+    // nes_color_t is packed r, g, b
+    fwrite(frame, sizeof(nes_color_t), PPU_RES_X * PPU_RES_Y, vfile);
+    frames_written++;
+    VacNull_PublishFrame(frame, hash);
+}
+
+void VacFile_QueueAudio(const void *data, uint32_t len)
+{
+    fwrite(data, 1, len, afile);
+}
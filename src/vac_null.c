@@ -0,0 +1,220 @@
+/*
+ * vac_null.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Headless backend for the Video, Audio, and Controllers wrapper. Nothing is
+ * shown or played, input comes from a script and time is a virtual clock
+ * that only moves when something waits on it, so runs go as fast as the
+ * host allows and come out the same every time.
+ *
+ * An input script has one "<frame> <keys...>" line per change: the keys
+ * are held from that frame (counted in published frames) until the next
+ * line. Keys are a, b, select, start, up, down, left, right, reset, pause,
+ * turbo, rewind and quit. Lines starting with '#' are comments.
+ *
+ *     0
+ *     60 start
+ *     62
+ *     90 a right
+ *     600 quit
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+#include <vac.h>
+#include <vac_backends.h>
+
+// stand in for a 60 Hz display when presenting on vsync
+#define REFRESH_NS 16666667ULL
+
+typedef struct script_entry {
+    u32 frame;
+    u32 keys;
+} script_entry_t;
+
+static script_entry_t *script = NULL;
+static size_t script_len = 0;
+
+static atomic_uint_fast64_t clock_ns = 0;
+static atomic_uint published = 0;
+static atomic_bool fresh = false;
+
+static const struct {
+    const char *name;
+    u32 key;
+} key_names[] = {
+    {"a", KEY_A},
+    {"b", KEY_B},
+    {"select", KEY_SELECT},
+    {"start", KEY_START},
+    {"up", KEY_UP},
+    {"down", KEY_DOWN},
+    {"left", KEY_LEFT},
+    {"right", KEY_RIGHT},
+    {"reset", KEY_RESET},
+    {"pause", KEY_PAUSE},
+    {"turbo", KEY_TURBO},
+    {"rewind", KEY_REWIND},
+    {"quit", KEY_QUIT},
+};
+
+static u32 parse_keys(char *list, const char *path, int lineno)
+{
+    u32 keys = 0;
+    for (char *tok = strtok(list, " \t\r\n"); tok != NULL; tok = strtok(NULL, " \t\r\n")) {
+        size_t i;
+        for (i = 0; i < sizeof(key_names) / sizeof(key_names[0]); i++) {
+            if (strcasecmp(tok, key_names[i].name) == 0) {
+                keys |= key_names[i].key;
+                break;
+            }
+        }
+        if (i == sizeof(key_names) / sizeof(key_names[0])) {
+            ERROR("%s:%d: unknown key \"%s\"\n", path, lineno, tok);
+            EXIT(1);
+        }
+    }
+    return keys;
+}
+
+static void load_script(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror("fopen");
+        ERROR("Failed to open %s\n", path);
+        EXIT(1);
+    }
+
+    size_t cap = 64;
+    script = malloc(cap * sizeof(script_entry_t));
+    char line[256];
+    int lineno = 0;
+    while (script != NULL && fgets(line, sizeof(line), file) != NULL) {
+        lineno++;
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') {
+            continue;
+        }
+        char *end;
+        unsigned long frame = strtoul(p, &end, 10);
+        if (end == p || (script_len > 0 && frame < script[script_len - 1].frame)) {
+            ERROR("%s:%d: expected \"<frame> <keys...>\" with frames in order\n", path, lineno);
+            EXIT(1);
+        }
+        if (script_len == cap) {
+            cap *= 2;
+            script = realloc(script, cap * sizeof(script_entry_t));
+            if (script == NULL) {
+                break;
+            }
+        }
+        script[script_len].frame = frame;
+        script[script_len].keys = parse_keys(end, path, lineno);
+        script_len++;
+    }
+    fclose(file);
+    if (script == NULL) {
+        ERROR("Out of Host Memory!\n");
+        EXIT(1);
+    }
+    INFO("Loaded %lu input script entries from %s\n", (unsigned long) script_len, path);
+}
+
+void VacNull_Init(const vac_config_t *cfg)
+{
+    if (cfg->input_script != NULL) {
+        load_script(cfg->input_script);
+    }
+}
+
+void VacNull_Free()
+{
+    free(script);
+    script = NULL;
+    script_len = 0;
+}
+
+// always: a display refresh goes by whether or not there's a new frame
+bool VacNull_Refresh(bool always)
+{
+    if (always) {
+        VacNull_DelayNs(REFRESH_NS);
+    }
+    return atomic_exchange(&fresh, false);
+}
+
+u32 VacNull_Poll()
+{
+    return VacNull_Keys();
+}
+
+// keys held by the last script line at or before the current frame
+u32 VacNull_Keys()
+{
+    u32 frame = atomic_load(&published);
+    size_t lo = 0;
+    size_t hi = script_len;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (script[mid].frame <= frame) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo == 0 ? 0 : script[lo - 1].keys;
+}
+
+void VacNull_PublishFrame(const nes_color_t *frame, u64 hash)
+{
+    (void) frame;
+    (void) hash;
+    atomic_fetch_add(&published, 1);
+    atomic_store(&fresh, true);
+}
+
+void VacNull_SetPxPt(int table_side, u16 x, u16 y, nes_color_t color)
+{
+    (void) table_side;
+    (void) x;
+    (void) y;
+    (void) color;
+}
+
+void VacNull_SetPxNt(int table_side, u16 x, u16 y, nes_color_t color)
+{
+    (void) table_side;
+    (void) x;
+    (void) y;
+    (void) color;
+}
+
+u64 VacNull_NowNs()
+{
+    return atomic_load(&clock_ns);
+}
+
+// waiting just moves the clock on, the yield lets the other thread run
+void VacNull_DelayNs(u64 ns)
+{
+    atomic_fetch_add(&clock_ns, ns);
+    sched_yield();
+}
+
+void VacNull_SetWindowTitle(const char *title)
+{
+    (void) title;
+}
+
+void VacNull_QueueAudio(const void *data, uint32_t len)
+{
+    (void) data;
+    (void) len;
+}
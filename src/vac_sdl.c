@@ -0,0 +1,511 @@
+/*
+ * vac_sdl.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * SDL backend for the Video, Audio, and Controllers wrapper: a window, the
+ * default audio device and the keyboard.
+ */
+
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include <vac.h>
+#include <vac_backends.h>
+#include <SDL3/SDL.h>
+
+#define SDL_PERROR ERROR("SDL ERROR: %s\n", SDL_GetError())
+
+#define RES_X 256
+#define RES_Y 240
+#define DBG_RES_X (128*2 + 4)
+
+#define STICKY_LIMIT 10
+
+// ~100 ms of mono f32 audio at 44.1 kHz
+#define AUDIO_MAX_QUEUED (44100 * (int) sizeof(float) / 10)
+
+static int pxscale;
+static SDL_Window *window;
+static SDL_Renderer *renderer;
+static SDL_Texture *screen;
+static bool debug_on;
+
+// video buffers
+// The emulation thread copies each finished frame into the back buffer and
+// publishes it into the mailbox. The presentation thread swaps the newest
+// frame out of the mailbox into the front buffer. Neither side ever waits on
+// the other; the emulation just overwrites the mailbox if a frame is skipped.
+#define MAILBOX_FRESH 0x4
+static nes_color_t frames[3][RES_X * RES_Y];
+static atomic_uint mailbox = 1; // index of the buffer in the mailbox (+ fresh flag)
+static unsigned int back = 0;   // owned by the emulation thread
+static unsigned int front = 2;  // owned by the presentation thread
+// hash of each buffer's frame, travels through the mailbox with it
+static u64 frame_hash[3];
+// last frame actually presented, repeats of it aren't uploaded or presented
+static u64 shown_hash;
+static bool shown_valid = false;
+static u64 presented_frames = 0;
+static u64 duplicate_frames = 0;
+// debug view (pattern and nametables). the emulation thread draws into the
+// staging buffers, publishing copies them into the frame's slot so they go
+// through the mailbox with it. only copied while the debug view is on.
+static nes_color_t pt_vbuf[2][128*128];
+static nes_color_t nt_vbuf[2][RES_X*RES_Y];
+static nes_color_t pt_frames[3][2][128*128];
+static nes_color_t nt_frames[3][2][RES_X*RES_Y];
+
+// input snapshot shared with the emulation thread
+static atomic_uint keys = 0;
+
+// window title set from the emulation thread, applied on present
+static pthread_mutex_t title_lock = PTHREAD_MUTEX_INITIALIZER;
+static char pending_title[128];
+static bool title_dirty = false;
+
+// audio
+static SDL_AudioStream *audio_stream;
+static u8 dev_silence = 0;
+static void audio_callback(void *usedata, u8 *stream, int len);
+
+static int scale(int val)
+{
+    return val * pxscale;
+}
+
+static int scale_dbg(int val)
+{
+    return val * 2;
+}
+
+static void reset_draw_color()
+{
+    int rc = SDL_SetRenderDrawColor(renderer, 0x77, 0x85, 0x8C, SDL_ALPHA_OPAQUE);
+    if (rc != 0) {
+        SDL_PERROR;
+        EXIT(1);
+    }
+}
+
+static u32 set_key(SDL_Keycode keycode, u32 keystate)
+{
+    switch (keycode) {
+    // Game pad keys
+    case SDLK_j:
+        keystate |= KEY_A;
+        break;
+    case SDLK_k:
+        keystate |= KEY_B;
+        break;
+    case SDLK_w:
+        keystate |= KEY_UP;
+        break;
+    case SDLK_s:
+        keystate |= KEY_DOWN;
+        break;
+    case SDLK_d:
+        keystate |= KEY_RIGHT;
+        break;
+    case SDLK_a:
+        keystate |= KEY_LEFT;
+        break;
+    case SDLK_RETURN:
+        keystate |= KEY_START;
+        break;
+    case SDLK_RSHIFT:
+        keystate |= KEY_SELECT;
+        break;
+    // Debug tools
+    case SDLK_n:
+        keystate |= KEY_STEP;
+        break;
+    case SDLK_p:
+        keystate |= KEY_PAUSE;
+        break;
+    case SDLK_c:
+        keystate |= KEY_CONTINUE;
+        break;
+    case SDLK_f:
+        keystate |= KEY_FRAME_MODE;
+        break;
+    case SDLK_l:
+        keystate |= KEY_PAL_CHANGE;
+        break;
+    case SDLK_r:
+        keystate |= KEY_REWIND;
+        break;
+    case SDLK_t:
+        keystate |= KEY_TURBO;
+        break;
+    case SDLK_F5:
+        keystate |= KEY_SAVE_STATE;
+        break;
+    case SDLK_F9:
+        keystate |= KEY_LOAD_STATE;
+        break;
+    case SDLK_ESCAPE:
+        keystate |= KEY_RESET;
+        break;
+    // Mute Channels
+    case SDLK_1:
+        keystate |= KEY_MUTE_1;
+        break;
+    case SDLK_2:
+        keystate |= KEY_MUTE_2;
+        break;
+    case SDLK_3:
+        keystate |= KEY_MUTE_3;
+        break;
+    case SDLK_4:
+        keystate |= KEY_MUTE_4;
+        break;
+    case SDLK_5:
+        keystate |= KEY_MUTE_5;
+        break;
+    }
+    return keystate;
+}
+
+static u32 unset_key(SDL_Keycode keycode, u32 keystate)
+{
+    switch (keycode) {
+    // Game pad keys
+    case SDLK_j:
+        keystate &= ~KEY_A;
+        break;
+    case SDLK_k:
+        keystate &= ~KEY_B;
+        break;
+    case SDLK_w:
+        keystate &= ~KEY_UP;
+        break;
+    case SDLK_s:
+        keystate &= ~KEY_DOWN;
+        break;
+    case SDLK_d:
+        keystate &= ~KEY_RIGHT;
+        break;
+    case SDLK_a:
+        keystate &= ~KEY_LEFT;
+        break;
+    case SDLK_RETURN:
+        keystate &= ~KEY_START;
+        break;
+    case SDLK_RSHIFT:
+        keystate &= ~KEY_SELECT;
+        break;
+    // Debug tools
+    case SDLK_n:
+        keystate &= ~KEY_STEP;
+        break;
+    case SDLK_p:
+        keystate &= ~KEY_PAUSE;
+        break;
+    case SDLK_c:
+        keystate &= ~KEY_CONTINUE;
+        break;
+    case SDLK_f:
+        keystate &= ~KEY_FRAME_MODE;
+        break;
+    case SDLK_l:
+        keystate &= ~KEY_PAL_CHANGE;
+        break;
+    case SDLK_r:
+        keystate &= ~KEY_REWIND;
+        break;
+    case SDLK_t:
+        keystate &= ~KEY_TURBO;
+        break;
+    case SDLK_F5:
+        keystate &= ~KEY_SAVE_STATE;
+        break;
+    case SDLK_F9:
+        keystate &= ~KEY_LOAD_STATE;
+        break;
+    case SDLK_ESCAPE:
+        keystate &= ~KEY_RESET;
+        break;
+    // mute channels
+    case SDLK_1:
+        keystate &= ~KEY_MUTE_1;
+        break;
+    case SDLK_2:
+        keystate &= ~KEY_MUTE_2;
+        break;
+    case SDLK_3:
+        keystate &= ~KEY_MUTE_3;
+        break;
+    case SDLK_4:
+        keystate &= ~KEY_MUTE_4;
+        break;
+    case SDLK_5:
+        keystate &= ~KEY_MUTE_5;
+        break;
+    }
+    return keystate;
+}
+
+void VacSdl_Init(const vac_config_t *cfg)
+{
+    pxscale = cfg->debug_display ? 2 : 3;
+    debug_on = cfg->debug_display;
+
+    int rc;
+    // init sdl
+    rc = SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
+    if (rc < 0) {
+        ERROR("%s\n", SDL_GetError());
+        EXIT(1);
+    }
+
+    // init audio
+    // SDL_AudioSpec want, have;
+    // memset(&want, 0, sizeof(want));
+    // want.freq = 44100;
+    // want.format = AUDIO_F32;
+    // want.channels = 1;
+    // want.samples = 512; // TODO: find best val (must be power of 2)
+    const SDL_AudioSpec spec = { SDL_AUDIO_F32, 1, 44100 };
+    audio_stream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_OUTPUT, &spec, NULL, NULL);
+    if (audio_stream == NULL) {
+        ERROR("Failed to create audio stream: %s\n", SDL_GetError());
+        EXIT(1);
+    }
+
+    int wh = scale(RES_Y);
+    int ww = scale(RES_X);
+    if (debug_on) {
+        ww += (scale_dbg(DBG_RES_X));
+    }
+    // create window
+    window = SDL_CreateWindow(cfg->title, ww, wh, 0);
+    if (window == NULL) {
+        ERROR("%s\n", SDL_GetError());
+        EXIT(1);
+    }
+
+    // create renderer
+    u32 flags = SDL_RENDERER_ACCELERATED;
+    if (cfg->vsync) {
+        // present blocks until the next display refresh
+        flags |= SDL_RENDERER_PRESENTVSYNC;
+    }
+    renderer = SDL_CreateRenderer(window, NULL, flags);
+    if (renderer == NULL) {
+        ERROR("%s\n", SDL_GetError());
+        EXIT(1);
+    }
+
+    // nes_color_t is packed r, g, b so frames can be uploaded as is
+    screen = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB24,
+        SDL_TEXTUREACCESS_STREAMING, RES_X, RES_Y);
+    if (screen == NULL) {
+        ERROR("%s\n", SDL_GetError());
+        EXIT(1);
+    }
+
+    SDL_ResumeAudioDevice(SDL_GetAudioStreamDevice(audio_stream));
+}
+
+void VacSdl_Free()
+{
+    if (duplicate_frames > 0) {
+        INFO("Skipped %lu duplicate frames (%lu presented)\n",
+            (unsigned long) duplicate_frames, (unsigned long) presented_frames);
+    }
+    SDL_DestroyTexture(screen);
+    SDL_DestroyWindow(window);
+    SDL_DestroyRenderer(renderer);
+    SDL_Quit();
+}
+
+u32 VacSdl_Poll()
+{
+    static u32 keystate = 0;
+    SDL_Event e;
+    SDL_Keycode keycode;
+    while (SDL_PollEvent(&e)) {
+        switch (e.type) {
+        case SDL_EVENT_QUIT:
+            keystate |= KEY_QUIT;
+            break;
+        case SDL_EVENT_KEY_DOWN:
+            keycode = e.key.keysym.sym;
+            keystate = set_key(keycode, keystate);
+            break;
+        case SDL_EVENT_KEY_UP:
+            keycode = e.key.keysym.sym;
+            keystate = unset_key(keycode, keystate);
+            break;
+        case SDL_EVENT_WINDOW_EXPOSED:
+        case SDL_EVENT_WINDOW_RESIZED:
+            // window contents are gone, next frame must be drawn even if
+            // it's a repeat
+            shown_valid = false;
+            break;
+        }
+    }
+    atomic_store_explicit(&keys, keystate, memory_order_release);
+    return keystate;
+}
+
+u32 VacSdl_Keys()
+{
+    return atomic_load_explicit(&keys, memory_order_acquire);
+}
+
+// hash is the frame's Nes_HashFrame, repeats of the shown frame are skipped
+void VacSdl_PublishFrame(const nes_color_t *frame, u64 hash)
+{
+    memcpy(frames[back], frame, sizeof(frames[0]));
+    frame_hash[back] = hash;
+    if (debug_on) {
+        memcpy(pt_frames[back], pt_vbuf, sizeof(pt_vbuf));
+        memcpy(nt_frames[back], nt_vbuf, sizeof(nt_vbuf));
+    }
+
+    unsigned int prev = atomic_exchange_explicit(&mailbox, back | MAILBOX_FRESH,
+        memory_order_acq_rel);
+    back = prev & ~MAILBOX_FRESH;
+}
+
+// always: present even if no new frame came in (vsync paced presentation)
+// returns true if a new frame was presented
+bool VacSdl_Refresh(bool always)
+{
+    // the title changes even when the picture doesn't (fps on a pause screen)
+    pthread_mutex_lock(&title_lock);
+    if (title_dirty) {
+        SDL_SetWindowTitle(window, pending_title);
+        title_dirty = false;
+    }
+    pthread_mutex_unlock(&title_lock);
+
+    // grab the newest frame if there is one
+    bool fresh = (atomic_load_explicit(&mailbox, memory_order_acquire) & MAILBOX_FRESH) != 0;
+    if (fresh) {
+        unsigned int prev = atomic_exchange_explicit(&mailbox, front, memory_order_acq_rel);
+        front = prev & ~MAILBOX_FRESH;
+    } else if (!debug_on && !always) {
+        // nothing new to show
+        return false;
+    }
+
+    // identical to what's on screen already (pause screens, menus), skip the
+    // upload and, unless vsync needs the present for pacing, the present too
+    bool repeat = shown_valid && frame_hash[front] == shown_hash;
+    if (fresh && repeat) {
+        duplicate_frames++;
+    }
+    if (repeat && !debug_on && !always) {
+        return false;
+    }
+
+    SDL_RenderClear(renderer);
+
+    // draw out buffer
+    int rc;
+    if (!repeat) {
+        rc = SDL_UpdateTexture(screen, NULL, frames[front], RES_X * sizeof(nes_color_t));
+        if (rc != 0) {
+            SDL_PERROR;
+            EXIT(1);
+        }
+        shown_hash = frame_hash[front];
+        shown_valid = true;
+    }
+    SDL_FRect dst = {0, 0, scale(RES_X), scale(RES_Y)};
+    SDL_RenderTexture(renderer, screen, NULL, &dst);
+
+    // draw out debug display
+    if (debug_on) {
+        // draw pattern table
+        for (int table_side = 0; table_side < 2; table_side++) {
+            for (int y = 0; y < 128; y++) {
+                for (int x = 0; x < 128; x++) {
+                    // set color
+                    int col_id = (y * 128) + x;
+                    assert(table_side < 2);
+                    assert(col_id < (128*128));
+                    nes_color_t color = pt_frames[front][table_side][col_id];
+                    rc = SDL_SetRenderDrawColor(renderer, color.red, color.green, color.blue, SDL_ALPHA_OPAQUE);
+                    if (rc != 0) {
+                        SDL_PERROR;
+                        EXIT(1);
+                    }
+
+                    SDL_FRect rect;
+                    rect.x = scale_dbg(x + 1) + scale(RES_X) + (scale_dbg(128) * table_side
+                        + scale_dbg(1) * table_side);
+                    rect.y = scale_dbg(y + 1);
+                    rect.w = scale_dbg(1);
+                    rect.h = scale_dbg(1);
+                    SDL_RenderFillRect(renderer, &rect);
+                }
+            }
+        }
+    }
+
+    reset_draw_color();
+    SDL_RenderPresent(renderer);
+    presented_frames++;
+    return fresh && !repeat;
+}
+
+void VacSdl_SetPxPt(int table_side, u16 x, u16 y, nes_color_t color)
+{
+    assert(x < 128 && y < 128);
+    assert(debug_on);
+    assert(table_side >= 0 && table_side <= 1);
+
+    pt_vbuf[table_side][y*128 + x] = color;
+}
+
+void VacSdl_SetPxNt(int table_side, u16 x, u16 y, nes_color_t color)
+{
+    assert(x < 256 && y < 240);
+    assert(debug_on);
+    assert(table_side >= 0 && table_side <= 1);
+
+    nt_vbuf[table_side][y*256 + x] = color;
+}
+
+u64 VacSdl_NowNs()
+{
+    return SDL_GetTicksNS();
+}
+
+void VacSdl_DelayNs(u64 ns)
+{
+    SDL_DelayNS(ns);
+}
+
+void VacSdl_SetWindowTitle(const char *title)
+{
+    // only the presentation thread may touch the window
+    pthread_mutex_lock(&title_lock);
+    strncpy(pending_title, title, sizeof(pending_title) - 1);
+    title_dirty = true;
+    pthread_mutex_unlock(&title_lock);
+}
+
+// *********************************************************
+// *** AUDIO ***
+// *********************************************************
+
+void VacSdl_QueueAudio(const void* data, uint32_t len) {
+    // when running faster than real-time (fast forward) drop samples instead
+    // of building up seconds of latency
+    if (SDL_GetAudioStreamQueued(audio_stream) > AUDIO_MAX_QUEUED) {
+        return;
+    }
+    int rc = SDL_PutAudioStreamData(audio_stream, data, len);
+    if (rc < 0) {
+        ERROR("Failed to queue audio: %s/n", SDL_GetError());
+        EXIT(1);
+    }
+}
+
@@ -0,0 +1,179 @@
+/*
+ * a12_test.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Checks the a12 edge prediction (Ppu_A12Rises) against the edges in the
+ * ppu's own pattern table fetches, for every table and sprite size setup
+ * with empty, even, odd and mixed sprite tiles. The ppu runs alone, the
+ * rest of the machine is stubbed out and the stubbed Mem_PpuRead watches
+ * a12. Only pattern fetches count, like the mmc3 ignoring the short drops
+ * of the nametable fetches.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ppu.h>
+#include <mem.h>
+#include <cpu.h>
+#include <cart.h>
+#include <scheduler.h>
+
+#define FRAMES 3
+
+// the dot being clocked and the edges seen so far
+static u64 dot;
+static bool a12;
+static u64 edges_from;
+static u64 edges_to;
+static u32 edges;
+
+// stubs for what ppu.c uses
+u8 Mem_PpuRead(u16 addr)
+{
+    if (addr < 0x2000) {
+        bool hi = (addr & 0x1000) != 0;
+        if (hi && !a12 && dot > edges_from && dot <= edges_to) {
+            edges++;
+        }
+        a12 = hi;
+    }
+    return 0;
+}
+
+void Mem_PpuWrite(u8 data, u16 addr)
+{
+    (void) data;
+    (void) addr;
+}
+
+u8 Mem_CpuRead(u16 addr)
+{
+    (void) addr;
+    return 0;
+}
+
+const u8 *Mem_CpuPage(u8 hi)
+{
+    (void) hi;
+    return NULL;
+}
+
+void Cpu_Nmi()
+{
+}
+
+void Cpu_OamDma()
+{
+}
+
+void Cart_A12Changing()
+{
+}
+
+void Cart_A12Changed()
+{
+}
+
+void Cart_ChrDirty(enum chr_consumer who, u64 dirty[CHR_DIRTY_WORDS])
+{
+    (void) who;
+    (void) dirty;
+}
+
+u64 Sched_Now()
+{
+    return dot / 3;
+}
+
+enum oam_fill {
+    OAM_EMPTY, // no sprites on any line
+    OAM_EVEN,  // 8x16: all from $0000
+    OAM_ODD,   // 8x16: all from $1000
+    OAM_MIXED, // random tiles, crowded lines
+};
+
+static void fill_oam(enum oam_fill fill)
+{
+    Ppu_RegWrite(0, 3);
+    for (int i = 0; i < 64; i++) {
+        u8 y = fill == OAM_EMPTY ? 0xFF : rand() % 240;
+        u8 tile = rand() & 0xFF;
+        if (fill == OAM_EVEN) {
+            tile &= 0xFE;
+        } else if (fill == OAM_ODD) {
+            tile |= 0x01;
+        }
+        Ppu_RegWrite(y, 4);
+        Ppu_RegWrite(tile, 4);
+        Ppu_RegWrite(0, 4);
+        Ppu_RegWrite(rand() & 0xFF, 4);
+    }
+}
+
+static void step_frame()
+{
+    bool done = false;
+    while (!done) {
+        done = Ppu_Step(1);
+        dot++;
+    }
+}
+
+static const struct {
+    u8 ppuctrl;
+    const char *name;
+} setups[] = {
+    {0x00, "bg $0000, 8x8 sprites $0000"},
+    {0x08, "bg $0000, 8x8 sprites $1000"},
+    {0x10, "bg $1000, 8x8 sprites $0000"},
+    {0x18, "bg $1000, 8x8 sprites $1000"},
+    {0x20, "bg $0000, 8x16 sprites"},
+    {0x30, "bg $1000, 8x16 sprites"},
+};
+
+static const char *fill_names[] = {"empty", "even tiles", "odd tiles", "mixed tiles"};
+
+int main()
+{
+    Ppu_Init();
+    int failed = 0;
+    for (unsigned seed = 1; seed <= 4; seed++) {
+        srand(seed);
+        for (size_t i = 0; i < sizeof(setups) / sizeof(setups[0]); i++) {
+            for (int fill = OAM_EMPTY; fill <= OAM_MIXED; fill++) {
+                Ppu_Reset();
+                dot = 0;
+                a12 = false;
+                edges_from = edges_to = 0;
+                Ppu_RegWrite(setups[i].ppuctrl, 0);
+                Ppu_RegWrite(0x1E, 1);
+                fill_oam(fill);
+                // settle, then count over whole frames from the pre-render line
+                step_frame();
+                u64 from = dot / 3;
+                u64 to = from + FRAMES * 341 * 262 / 3;
+                edges_from = from * 3;
+                edges_to = to * 3;
+                edges = 0;
+                u32 predicted = Ppu_A12Rises(from, to);
+                while (dot <= edges_to) {
+                    Ppu_Step(1);
+                    dot++;
+                }
+                if (predicted != edges) {
+                    fprintf(stderr, "seed %u, %s, %s: predicted %u edges, fetched %u\n", seed,
+                        setups[i].name, fill_names[fill], predicted, edges);
+                    failed++;
+                }
+            }
+        }
+    }
+    if (failed > 0) {
+        return 1;
+    }
+    printf("a12: ok\n");
+    return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * frame_irq_test.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Runs a tiny NROM program that writes $4017, enables interrupts and sets a
+ * flag in a loop, with an irq handler that sets another without
+ * acknowledging. A write that inhibits the frame irq or selects the 5-step
+ * sequence has to keep the cpu out of the handler, one that doesn't has to
+ * land in it for good.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <libnes.h>
+#include <mem.h>
+
+#define PRG_SIZE (16 * 1024)
+#define CHR_SIZE (8 * 1024)
+#define FRAMES 10
+
+// zero page flags
+#define LOOPED 0x00
+#define IRQ_TAKEN 0x01
+
+static u8 rom[16 + PRG_SIZE + CHR_SIZE];
+
+// prg-rom is mirrored at $8000 and $C000, the code is at $C000
+static void build_rom(u8 frame_counter)
+{
+    static const u8 header[16] = {'N', 'E', 'S', 0x1A, 1, 1};
+    memset(rom, 0, sizeof(rom));
+    memcpy(rom, header, sizeof(header));
+    u8 *prg = rom + 16;
+    const u8 code[] = {
+        0x78,                   // $C000 sei
+        0xA2, 0xFF,             //       ldx #$FF
+        0x9A,                   //       txs
+        0xA9, frame_counter,    //       lda #frame_counter
+        0x8D, 0x17, 0x40,       //       sta $4017
+        0x58,                   //       cli
+        0xA9, 0x01,             // $C00A lda #1
+        0x85, LOOPED,           //       sta LOOPED
+        0x4C, 0x0A, 0xC0,       //       jmp $C00A
+        0xA9, 0x01,             // $C011 lda #1
+        0x85, IRQ_TAKEN,        //       sta IRQ_TAKEN
+        0x40,                   //       rti (never acknowledged)
+    };
+    memcpy(prg, code, sizeof(code));
+    // nmi and reset at $C000 (nmi is never enabled), irq at $C011
+    const u8 vectors[6] = {0x00, 0xC0, 0x00, 0xC0, 0x11, 0xC0};
+    memcpy(prg + PRG_SIZE - 6, vectors, sizeof(vectors));
+}
+
+static const struct {
+    u8 frame_counter;
+    bool irq;
+    const char *name;
+} cases[] = {
+    {0x00, true, "4-step"},
+    {0x40, false, "4-step, irq inhibited"},
+    {0x80, false, "5-step"},
+    {0xC0, false, "5-step, irq inhibited"},
+};
+
+int main()
+{
+    Nes_Init();
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        build_rom(cases[i].frame_counter);
+        if (!Nes_LoadRom(rom, sizeof(rom))) {
+            fprintf(stderr, "%s: rom didn't load\n", cases[i].name);
+            return 1;
+        }
+        u8 *ram = Mem_Iram();
+        for (int f = 0; f < FRAMES - 1; f++) {
+            Nes_StepFrame();
+        }
+        // stuck in the handler, the main loop doesn't get another go
+        ram[LOOPED] = 0;
+        Nes_StepFrame();
+        bool irq = ram[IRQ_TAKEN] != 0;
+        bool looped = ram[LOOPED] != 0;
+        if (irq != cases[i].irq || looped == cases[i].irq) {
+            fprintf(stderr, "%s: expected %s, irq taken %d, main loop ran in the last frame %d\n",
+                cases[i].name, cases[i].irq ? "the irq to hold" : "no irq", irq, looped);
+            failed++;
+        }
+    }
+    if (failed > 0) {
+        return 1;
+    }
+    printf("frame_irq: ok\n");
+    return 0;
+}
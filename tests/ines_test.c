@@ -0,0 +1,175 @@
+/*
+ * ines_test.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Table of iNES and NES 2.0 headers against what Ines_ReadHeader should make
+ * of them: bank counts and exponent sizes, ram shift counts, DiskDude junk
+ * and headers it has to turn down. Then a rom with a trainer, which has to be
+ * left out of the data crc and land at $7000 with prg-rom still at $8000.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <libnes.h>
+#include <ines.h>
+#include <cart.h>
+
+#define KB(n) ((size_t) (n) * 1024)
+
+static const struct {
+    const char *name;
+    u8 header[INES_HEADER_SIZE];
+    size_t len;
+    bool ok;
+    ines_header_t want;
+} cases[] = {
+    {"ines, vertical", {'N', 'E', 'S', 0x1A, 2, 1, 0x01}, 16, true,
+        {.prgrom_size = KB(32), .chrrom_size = KB(8), .prgram_size = KB(8),
+         .mirror_mode = MIR_VERT}},
+    {"ines, mmc3 with battery, 2 prg-ram units", {'N', 'E', 'S', 0x1A, 8, 16, 0x42, 0x00, 2}, 16, true,
+        {.prgrom_size = KB(128), .chrrom_size = KB(128), .prgnvram_size = KB(16),
+         .battery = true, .mapper_num = 4, .mirror_mode = MIR_HORZ}},
+    {"ines, chr-ram, four screen", {'N', 'E', 'S', 0x1A, 1, 0, 0x08}, 16, true,
+        {.prgrom_size = KB(16), .prgram_size = KB(8), .chrram_size = KB(8),
+         .mirror_mode = MIR_4SCRN}},
+    {"ines, high mapper nibble", {'N', 'E', 'S', 0x1A, 1, 1, 0x40, 0x10}, 16, true,
+        {.prgrom_size = KB(16), .chrrom_size = KB(8), .prgram_size = KB(8),
+         .mapper_num = 20, .mirror_mode = MIR_HORZ}},
+    {"ines, DiskDude junk", {'N', 'E', 'S', 0x1A, 8, 16, 0x10, 'D', 'i', 's', 'k', 'D', 'u', 'd', 'e', '!'}, 16, true,
+        {.prgrom_size = KB(128), .chrrom_size = KB(128), .prgram_size = KB(8),
+         .mapper_num = 1, .mirror_mode = MIR_HORZ}},
+    {"ines, trainer", {'N', 'E', 'S', 0x1A, 1, 1, 0x05}, 16, true,
+        {.prgrom_size = KB(16), .chrrom_size = KB(8), .prgram_size = KB(8),
+         .trainer = true, .mirror_mode = MIR_VERT}},
+    {"nes2, mapper 256 submapper 2", {'N', 'E', 'S', 0x1A, 2, 1, 0x00, 0x08, 0x21, 0x00, 0x70, 0x07}, 16, true,
+        {.nes2 = true, .prgrom_size = KB(32), .chrrom_size = KB(8), .prgnvram_size = KB(8),
+         .chrram_size = KB(8), .mapper_num = 256, .submapper = 2, .mirror_mode = MIR_HORZ}},
+    {"nes2, 12 bit bank counts", {'N', 'E', 'S', 0x1A, 0x00, 0x02, 0x00, 0x08, 0x00, 0x11}, 16, true,
+        {.nes2 = true, .prgrom_size = KB(4096), .chrrom_size = KB(2064), .mirror_mode = MIR_HORZ}},
+    {"nes2, exponent prg 2^14*3", {'N', 'E', 'S', 0x1A, 0x39, 1, 0x00, 0x08, 0x00, 0x0F}, 16, true,
+        {.nes2 = true, .prgrom_size = KB(48), .chrrom_size = KB(8), .mirror_mode = MIR_HORZ}},
+    {"nes2, exponent chr 2^13*1", {'N', 'E', 'S', 0x1A, 2, 0x34, 0x00, 0x08, 0x00, 0xF0}, 16, true,
+        {.nes2 = true, .prgrom_size = KB(32), .chrrom_size = KB(8), .mirror_mode = MIR_HORZ}},
+    {"nes2, exponent 2^0*7", {'N', 'E', 'S', 0x1A, 0x03, 1, 0x00, 0x08, 0x00, 0x0F}, 16, true,
+        {.nes2 = true, .prgrom_size = 7, .chrrom_size = KB(8), .mirror_mode = MIR_HORZ}},
+    {"nes2, exponent 2^32", {'N', 'E', 'S', 0x1A, 0x80, 1, 0x00, 0x08, 0x00, 0x0F}, 16, true,
+        {.nes2 = true, .prgrom_size = (size_t) 1 << 32, .chrrom_size = KB(8), .mirror_mode = MIR_HORZ}},
+    {"nes2, exponent 2^33 too large", {'N', 'E', 'S', 0x1A, 0x84, 1, 0x00, 0x08, 0x00, 0x0F}, 16, false, {0}},
+    {"nes2, chr exponent 2^63 too large", {'N', 'E', 'S', 0x1A, 1, 0xFC, 0x00, 0x08, 0x00, 0xF0}, 16, false, {0}},
+    {"bad magic", {'N', 'E', 'S', 0x00, 1, 1}, 16, false, {0}},
+    {"short header", {'N', 'E', 'S', 0x1A, 1, 1}, 15, false, {0}},
+    {"magic only", {'N', 'E', 'S', 0x1A}, 4, false, {0}},
+};
+
+static bool same(const ines_header_t *a, const ines_header_t *b)
+{
+    return a->nes2 == b->nes2
+        && a->prgrom_size == b->prgrom_size
+        && a->chrrom_size == b->chrrom_size
+        && a->prgram_size == b->prgram_size
+        && a->prgnvram_size == b->prgnvram_size
+        && a->chrram_size == b->chrram_size
+        && a->chrnvram_size == b->chrnvram_size
+        && a->battery == b->battery
+        && a->trainer == b->trainer
+        && a->mapper_num == b->mapper_num
+        && a->submapper == b->submapper
+        && a->mirror_mode == b->mirror_mode;
+}
+
+static void print_header(const char *what, const ines_header_t *h)
+{
+    fprintf(stderr, "  %s: nes2 %d prg %zu chr %zu prgram %u prgnvram %u chrram %u chrnvram %u "
+        "battery %d trainer %d mapper %u.%u mirror %d\n", what, h->nes2, h->prgrom_size,
+        h->chrrom_size, h->prgram_size, h->prgnvram_size, h->chrram_size, h->chrnvram_size,
+        h->battery, h->trainer, h->mapper_num, h->submapper, h->mirror_mode);
+}
+
+static int check_headers()
+{
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        ines_header_t got;
+        bool ok = Ines_ReadHeader(cases[i].header, cases[i].len, &got);
+        if (ok != cases[i].ok) {
+            fprintf(stderr, "%s: expected %s\n", cases[i].name, cases[i].ok ? "a header" : "failure");
+            failed++;
+        } else if (ok && !same(&got, &cases[i].want)) {
+            fprintf(stderr, "%s: wrong header\n", cases[i].name);
+            print_header("got", &got);
+            print_header("want", &cases[i].want);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+// nrom, 16 KB prg and 8 KB chr, with or without a trainer and junk on the end
+static u8 rom[INES_HEADER_SIZE + INES_TRAINER_SIZE + KB(16) + KB(8) + 128];
+
+static size_t build_rom(bool trainer, bool junk)
+{
+    const u8 header[INES_HEADER_SIZE] = {'N', 'E', 'S', 0x1A, 1, 1, trainer ? 0x04 : 0x00};
+    memset(rom, 0, sizeof(rom));
+    memcpy(rom, header, sizeof(header));
+    u8 *p = rom + INES_HEADER_SIZE;
+    if (trainer) {
+        memset(p, 0xAA, INES_TRAINER_SIZE);
+        p += INES_TRAINER_SIZE;
+    }
+    for (size_t i = 0; i < KB(16) + KB(8); i++) {
+        p[i] = (u8) (i * 7 + 1);
+    }
+    p += KB(16) + KB(8);
+    if (junk) {
+        memset(p, 0xEE, 128);
+        p += 128;
+    }
+    return p - rom;
+}
+
+static int check_trainer()
+{
+    int failed = 0;
+    ines_header_t plain, trained;
+    size_t plain_len = build_rom(false, false);
+    Ines_ReadHeader(rom, plain_len, &plain);
+    u32 plain_crc = Ines_DataCrc(&plain, rom, plain_len);
+
+    size_t len = build_rom(true, true);
+    Ines_ReadHeader(rom, len, &trained);
+    u32 crc = Ines_DataCrc(&trained, rom, len);
+    if (crc != plain_crc) {
+        fprintf(stderr, "trainer: data crc %08x, %08x without the trainer\n", crc, plain_crc);
+        failed++;
+    }
+
+    Nes_Init();
+    if (!Nes_LoadRom(rom, len)) {
+        fprintf(stderr, "trainer: rom didn't load\n");
+        return failed + 1;
+    }
+    u8 at_7000 = Cart_CpuRead(0x7000);
+    u8 at_71ff = Cart_CpuRead(0x71FF);
+    u8 at_8000 = Cart_CpuRead(0x8000);
+    u8 at_8001 = Cart_CpuRead(0x8001);
+    if (at_7000 != 0xAA || at_71ff != 0xAA || at_8000 != 1 || at_8001 != 8) {
+        fprintf(stderr, "trainer: $7000 %02x $71FF %02x $8000 %02x $8001 %02x, expected aa aa 01 08\n",
+            at_7000, at_71ff, at_8000, at_8001);
+        failed++;
+    }
+    return failed;
+}
+
+int main()
+{
+    int failed = check_headers() + check_trainer();
+    if (failed > 0) {
+        return 1;
+    }
+    printf("ines: ok\n");
+    return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * rewind_test.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Fills the rewind arena several times over with random sized deltas, then
+ * rewinds all the way back, checking every frame that comes out against the
+ * state it was pushed as. The machine state is stubbed out.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <rewind.h>
+#include <state.h>
+#include <vac.h>
+
+#define TEST_STATE_SIZE (8*1024)
+#define FRAMES 3000
+
+// stubs for what rewind.c uses
+static u8 machine[TEST_STATE_SIZE];
+
+size_t State_Size()
+{
+    return TEST_STATE_SIZE;
+}
+
+void State_Save(u8 *buf)
+{
+    memcpy(buf, machine, TEST_STATE_SIZE);
+}
+
+bool State_Load(const u8 *buf, size_t len)
+{
+    assert(len == TEST_STATE_SIZE);
+    memcpy(machine, buf, TEST_STATE_SIZE);
+    return true;
+}
+
+u64 Vac_NowNs()
+{
+    return 0;
+}
+
+static u8 history[FRAMES + 1][TEST_STATE_SIZE];
+
+static int run(unsigned seed)
+{
+    srand(seed);
+    memset(machine, 0, sizeof(machine));
+    Rewind_Init(1);
+    Rewind_Clear();
+    memcpy(history[0], machine, TEST_STATE_SIZE);
+
+    for (int f = 1; f <= FRAMES; f++) {
+        // a frame changes 500-5500 bytes in runs, so deltas vary in size
+        int changed = 500 + rand() % 5001;
+        while (changed > 0) {
+            int at = rand() % TEST_STATE_SIZE;
+            int run = 1 + rand() % 64;
+            for (int i = 0; i < run && at + i < TEST_STATE_SIZE; i++) {
+                machine[at + i] = rand();
+            }
+            changed -= run;
+        }
+        memcpy(history[f], machine, TEST_STATE_SIZE);
+        Rewind_Push();
+    }
+
+    int f = FRAMES;
+    int popped = 0;
+    while (Rewind_Pop()) {
+        f--;
+        popped++;
+        if (memcmp(machine, history[f], TEST_STATE_SIZE) != 0) {
+            fprintf(stderr, "seed %u: frame %d is wrong after %d pops\n", seed, f, popped);
+            return 1;
+        }
+    }
+    if (popped == 0 || memcmp(machine, history[f], TEST_STATE_SIZE) != 0) {
+        fprintf(stderr, "seed %u: oldest frame %d is wrong\n", seed, f);
+        return 1;
+    }
+
+    // push again from the middle of history, then rewind through it
+    for (int i = 0; i < FRAMES / 2; i++) {
+        machine[rand() % TEST_STATE_SIZE] ^= 0xFF;
+        Rewind_Push();
+    }
+    while (Rewind_Pop()) {
+    }
+    Rewind_Free();
+    return 0;
+}
+
+int main()
+{
+    for (unsigned seed = 1; seed <= 8; seed++) {
+        if (run(seed) != 0) {
+            return 1;
+        }
+    }
+    printf("rewind: ok\n");
+    return 0;
+}
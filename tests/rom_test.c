@@ -0,0 +1,234 @@
+/*
+ * rom_test.c
+ *
+ * Travis Banken
+ * 2020
+ *
+ * Table of gzip and zip images, good and broken, against Rom_FromMemory.
+ * Good ones have to come out as the bytes that went in, whatever size the
+ * zip header claims (it's only a hint), truncated, corrupt and unsupported
+ * ones have to be turned down instead of handing out a partial image.
+ * Plain roms pass through untouched.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <rom.h>
+
+#define PAYLOAD_SIZE (40 * 1024 + 16)
+#define BUF_SIZE (2 * PAYLOAD_SIZE)
+
+static u8 payload[PAYLOAD_SIZE];
+static u8 buf[BUF_SIZE];
+
+static void put_le16(u8 *p, u16 v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put_le32(u8 *p, u32 v)
+{
+    put_le16(p, v & 0xFFFF);
+    put_le16(p + 2, v >> 16);
+}
+
+// deflate the payload into out, gzip wrapped or raw. the compressed size.
+static size_t deflate_payload(u8 *out, size_t cap, bool gzip)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, gzip ? MAX_WBITS + 16 : -MAX_WBITS, 8,
+        Z_DEFAULT_STRATEGY);
+    zs.next_in = payload;
+    zs.avail_in = PAYLOAD_SIZE;
+    zs.next_out = out;
+    zs.avail_out = cap;
+    int ret = deflate(&zs, Z_FINISH);
+    size_t len = zs.total_out;
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END ? len : 0;
+}
+
+enum damage {
+    INTACT,
+    TRUNCATE_HALF,   // cut in the middle of the data
+    TRUNCATE_TAIL,   // lose the last 4 bytes (the gzip size)
+    BAD_CRC,         // gzip trailer crc off by one
+    BAD_DATA,        // an invalid deflate block type up front
+    SIZE_HINT_SMALL, // the declared size is 1 byte (gzip checks its size)
+    SIZE_HINT_ZERO,  // zip: sizes in a data descriptor, header says 0
+    STORED_OVERRUN,  // zip: stored size runs past the end
+    NAME_OVERRUN,    // zip: file name runs past the end
+    UNSUPPORTED,     // zip: bzip2 compressed
+    SHORT_HEADER,    // zip: not even a local header
+};
+
+static size_t build_gzip(enum damage damage)
+{
+    size_t len = deflate_payload(buf, BUF_SIZE, true);
+    if (len < 18) {
+        return 0;
+    }
+    switch (damage) {
+    case TRUNCATE_HALF:
+        return len / 2;
+    case TRUNCATE_TAIL:
+        return len - 4;
+    case BAD_CRC:
+        buf[len - 8] ^= 0x01;
+        break;
+    case BAD_DATA:
+        // first block header after the 10 byte gzip header: btype 3
+        buf[10] |= 0x06;
+        break;
+    case SIZE_HINT_SMALL:
+        put_le32(buf + len - 4, 1);
+        break;
+    default:
+        break;
+    }
+    return len;
+}
+
+// a zip holding the payload as its first file, stored or deflated
+static size_t build_zip(bool deflated, enum damage damage)
+{
+    const char *name = "game.nes";
+    u8 *data = buf + 30 + strlen(name);
+    size_t data_len;
+    if (deflated) {
+        data_len = deflate_payload(data, BUF_SIZE - (data - buf), false);
+    } else {
+        memcpy(data, payload, PAYLOAD_SIZE);
+        data_len = PAYLOAD_SIZE;
+    }
+
+    memset(buf, 0, 30);
+    memcpy(buf, "PK\x03\x04", 4);
+    put_le16(buf + 4, 20);
+    put_le16(buf + 8, deflated ? 8 : 0);
+    put_le32(buf + 14, crc32(0, payload, PAYLOAD_SIZE));
+    put_le32(buf + 18, data_len);
+    put_le32(buf + 22, PAYLOAD_SIZE);
+    put_le16(buf + 26, strlen(name));
+    memcpy(buf + 30, name, strlen(name));
+    size_t len = data - buf + data_len;
+
+    switch (damage) {
+    case TRUNCATE_HALF:
+        return len / 2;
+    case BAD_DATA:
+        data[0] |= 0x06;
+        break;
+    case SIZE_HINT_SMALL:
+        put_le32(buf + 22, 1);
+        break;
+    case SIZE_HINT_ZERO:
+        put_le16(buf + 6, 0x8);
+        put_le32(buf + 14, 0);
+        put_le32(buf + 18, 0);
+        put_le32(buf + 22, 0);
+        break;
+    case STORED_OVERRUN:
+        put_le32(buf + 22, PAYLOAD_SIZE + 1);
+        break;
+    case NAME_OVERRUN:
+        put_le16(buf + 28, len);
+        break;
+    case UNSUPPORTED:
+        put_le16(buf + 8, 12);
+        break;
+    case SHORT_HEADER:
+        return 29;
+    default:
+        break;
+    }
+    return len;
+}
+
+enum format {
+    PLAIN,
+    GZIP,
+    ZIP_STORED,
+    ZIP_DEFLATED,
+};
+
+static const struct {
+    const char *name;
+    enum format format;
+    enum damage damage;
+    bool ok;
+} cases[] = {
+    {"plain", PLAIN, INTACT, true},
+    {"gzip", GZIP, INTACT, true},
+    {"gzip, wrong size in the trailer", GZIP, SIZE_HINT_SMALL, false},
+    {"gzip, truncated", GZIP, TRUNCATE_HALF, false},
+    {"gzip, trailer cut off", GZIP, TRUNCATE_TAIL, false},
+    {"gzip, bad crc", GZIP, BAD_CRC, false},
+    {"gzip, corrupt data", GZIP, BAD_DATA, false},
+    {"zip stored", ZIP_STORED, INTACT, true},
+    {"zip stored, truncated", ZIP_STORED, TRUNCATE_HALF, false},
+    {"zip stored, size past the end", ZIP_STORED, STORED_OVERRUN, false},
+    {"zip stored, sizes in a data descriptor", ZIP_STORED, SIZE_HINT_ZERO, false},
+    {"zip deflated", ZIP_DEFLATED, INTACT, true},
+    {"zip deflated, size hint too small", ZIP_DEFLATED, SIZE_HINT_SMALL, true},
+    {"zip deflated, sizes in a data descriptor", ZIP_DEFLATED, SIZE_HINT_ZERO, true},
+    {"zip deflated, truncated", ZIP_DEFLATED, TRUNCATE_HALF, false},
+    {"zip deflated, corrupt data", ZIP_DEFLATED, BAD_DATA, false},
+    {"zip, name past the end", ZIP_DEFLATED, NAME_OVERRUN, false},
+    {"zip, bzip2", ZIP_DEFLATED, UNSUPPORTED, false},
+    {"zip, short header", ZIP_STORED, SHORT_HEADER, false},
+};
+
+int main()
+{
+    for (size_t i = 0; i < PAYLOAD_SIZE; i++) {
+        payload[i] = (u8) (i * 7 + (i >> 9));
+    }
+    memcpy(payload, "NES\x1A", 4);
+
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        size_t len;
+        switch (cases[i].format) {
+        case GZIP:
+            len = build_gzip(cases[i].damage);
+            break;
+        case ZIP_STORED:
+            len = build_zip(false, cases[i].damage);
+            break;
+        case ZIP_DEFLATED:
+            len = build_zip(true, cases[i].damage);
+            break;
+        default:
+            memcpy(buf, payload, PAYLOAD_SIZE);
+            len = PAYLOAD_SIZE;
+            break;
+        }
+        if (len == 0) {
+            fprintf(stderr, "%s: couldn't build the image\n", cases[i].name);
+            failed++;
+            continue;
+        }
+
+        const rom_image_t *image = Rom_FromMemory(buf, len);
+        if ((image != NULL) != cases[i].ok) {
+            fprintf(stderr, "%s: expected %s\n", cases[i].name, cases[i].ok ? "an image" : "failure");
+            failed++;
+        } else if (image != NULL
+                && (image->len != PAYLOAD_SIZE || memcmp(image->data, payload, PAYLOAD_SIZE) != 0)) {
+            fprintf(stderr, "%s: image of %zu bytes doesn't match the %d byte rom\n", cases[i].name,
+                image->len, PAYLOAD_SIZE);
+            failed++;
+        }
+        Rom_Close(image);
+    }
+    if (failed > 0) {
+        return 1;
+    }
+    printf("rom: ok\n");
+    return 0;
+}